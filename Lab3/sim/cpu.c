@@ -0,0 +1,486 @@
+/* cpu.c
+   RV32IM + Zicsr machine-mode hart. Instructions are decoded once into a
+   per-page cache of struct insn and re-decoded only after a store hits
+   the word they came from. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dtekv-sim.h"
+
+#define SEXT(v, bits) ((int32_t)((uint32_t)(v) << (32 - (bits))) >> (32 - (bits)))
+
+static void decode(uint32_t w, struct insn *d)
+{
+  unsigned opc = w & 0x7f, f3 = (w >> 12) & 7, f7 = w >> 25;
+  int32_t i_imm = (int32_t)w >> 20;
+  int32_t s_imm = SEXT(((w >> 20) & 0xfe0) | ((w >> 7) & 0x1f), 12);
+  int32_t b_imm = SEXT(((w >> 19) & 0x1000) | ((w << 4) & 0x800)
+                       | ((w >> 20) & 0x7e0) | ((w >> 7) & 0x1e), 13);
+  int32_t u_imm = (int32_t)(w & 0xfffff000u);
+  int32_t j_imm = SEXT(((w >> 11) & 0x100000) | (w & 0xff000)
+                       | ((w >> 9) & 0x800) | ((w >> 20) & 0x7fe), 21);
+  static const uint8_t branch[8] = { OP_BEQ, OP_BNE, OP_ILLEGAL, OP_ILLEGAL,
+                                     OP_BLT, OP_BGE, OP_BLTU, OP_BGEU };
+  static const uint8_t load[8] = { OP_LB, OP_LH, OP_LW, OP_ILLEGAL,
+                                   OP_LBU, OP_LHU, OP_ILLEGAL, OP_ILLEGAL };
+  static const uint8_t store[8] = { OP_SB, OP_SH, OP_SW, OP_ILLEGAL,
+                                    OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL };
+  static const uint8_t alui[8] = { OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU,
+                                   OP_XORI, OP_SRLI, OP_ORI, OP_ANDI };
+  static const uint8_t alu[8] = { OP_ADD, OP_SLL, OP_SLT, OP_SLTU,
+                                  OP_XOR, OP_SRL, OP_OR, OP_AND };
+  static const uint8_t mul[8] = { OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU,
+                                  OP_DIV, OP_DIVU, OP_REM, OP_REMU };
+  static const uint8_t csr[8] = { OP_ILLEGAL, OP_CSRRW, OP_CSRRS, OP_CSRRC,
+                                  OP_ILLEGAL, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI };
+
+  d->rd = (w >> 7) & 31;
+  d->rs1 = (w >> 15) & 31;
+  d->rs2 = (w >> 20) & 31;
+  d->op = OP_ILLEGAL;
+  d->imm = (int32_t)w;        /* raw word, reported as mtval if illegal */
+
+  switch (opc) {
+  case 0x37: d->op = OP_LUI;   d->imm = u_imm; break;
+  case 0x17: d->op = OP_AUIPC; d->imm = u_imm; break;
+  case 0x6f: d->op = OP_JAL;   d->imm = j_imm; break;
+  case 0x67:
+    if (f3 == 0) {
+      d->op = OP_JALR;
+      d->imm = i_imm;
+    }
+    break;
+  case 0x63:
+    if (branch[f3] != OP_ILLEGAL) {
+      d->op = branch[f3];
+      d->imm = b_imm;
+    }
+    break;
+  case 0x03:
+    if (load[f3] != OP_ILLEGAL) {
+      d->op = load[f3];
+      d->imm = i_imm;
+    }
+    break;
+  case 0x23:
+    if (store[f3] != OP_ILLEGAL) {
+      d->op = store[f3];
+      d->imm = s_imm;
+    }
+    break;
+  case 0x13:
+    if (f3 == 1) {
+      if (f7 == 0) {
+        d->op = OP_SLLI;
+        d->imm = d->rs2;
+      }
+    } else if (f3 == 5) {
+      if (f7 == 0 || f7 == 0x20) {
+        d->op = f7 ? OP_SRAI : OP_SRLI;
+        d->imm = d->rs2;
+      }
+    } else {
+      d->op = alui[f3];
+      d->imm = i_imm;
+    }
+    break;
+  case 0x33:
+    if (f7 == 0)
+      d->op = alu[f3];
+    else if (f7 == 1)
+      d->op = mul[f3];
+    else if (f7 == 0x20 && f3 == 0)
+      d->op = OP_SUB;
+    else if (f7 == 0x20 && f3 == 5)
+      d->op = OP_SRA;
+    break;
+  case 0x0f:
+    if (f3 <= 1)
+      d->op = OP_FENCE;
+    break;
+  case 0x73:
+    if (f3 == 0) {
+      if (w == 0x00000073u) d->op = OP_ECALL;
+      else if (w == 0x00100073u) d->op = OP_EBREAK;
+      else if (w == 0x30200073u) d->op = OP_MRET;
+      else if (w == 0x10500073u) d->op = OP_WFI;
+    } else if (csr[f3] != OP_ILLEGAL) {
+      d->op = csr[f3];
+      d->imm = (int32_t)(w >> 20);
+    }
+    break;
+  }
+}
+
+static struct insn *fetch(struct sim *s, uint32_t pc)
+{
+  struct insn **page = &s->icache[pc >> PAGE_SHIFT];
+  struct insn *d;
+
+  if (*page == NULL) {
+    *page = calloc(PAGE_WORDS, sizeof(struct insn));
+    if (*page == NULL) {
+      perror("dtekv-sim");
+      exit(1);
+    }
+  }
+  d = &(*page)[(pc >> 2) & (PAGE_WORDS - 1)];
+  if (d->op == OP_UNDECODED) {
+    uint32_t w;
+    memcpy(&w, s->ram + pc, 4);
+    decode(w, d);
+    s->insn_decoded++;
+  }
+  return d;
+}
+
+static void trap(struct sim *s, uint32_t cause, uint32_t tval)
+{
+  uint32_t base = s->mtvec & ~3u;
+
+  s->mepc = s->pc;
+  s->mcause = cause;
+  s->mtval = tval;
+  s->mstatus = (s->mstatus & ~(MSTATUS_MPIE | MSTATUS_MIE))
+             | ((s->mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0)
+             | MSTATUS_MPP;
+  if ((s->mtvec & 1) && (cause & 0x80000000u))
+    s->pc = base + 4 * (cause & 0x7fffffffu);
+  else
+    s->pc = base;
+  s->traps++;
+}
+
+void cpu_reset(struct sim *s, uint32_t entry)
+{
+  memset(s->x, 0, sizeof(s->x));
+  s->pc = entry;
+  s->mstatus = MSTATUS_MPP;
+  s->mie = s->mip = s->mtvec = s->mepc = s->mcause = s->mtval = 0;
+}
+
+/* ---- memory ---- */
+
+static int load(struct sim *s, uint32_t a, unsigned size, uint32_t *v)
+{
+  if (a & (size - 1))
+    return EXC_LOAD_MISALIGNED;
+  if (a < RAM_SIZE) {
+    uint8_t *p = s->ram + a;
+    *v = size == 4 ? (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24
+       : size == 2 ? (uint32_t)p[0] | (uint32_t)p[1] << 8
+       : p[0];
+    return -1;
+  }
+  if (a - IO_BASE < IO_SIZE) {
+    uint32_t w = dev_read(s, a & ~3u);
+    *v = w >> (8 * (a & 3));
+    return -1;
+  }
+  return EXC_LOAD_FAULT;
+}
+
+static int store(struct sim *s, uint32_t a, unsigned size, uint32_t v)
+{
+  if (a & (size - 1))
+    return EXC_STORE_MISALIGNED;
+  if (a < RAM_SIZE) {
+    uint8_t *p = s->ram + a;
+    struct insn *page = s->icache[a >> PAGE_SHIFT];
+    p[0] = (uint8_t)v;
+    if (size >= 2)
+      p[1] = (uint8_t)(v >> 8);
+    if (size == 4) {
+      p[2] = (uint8_t)(v >> 16);
+      p[3] = (uint8_t)(v >> 24);
+    }
+    if (page != NULL)
+      page[(a >> 2) & (PAGE_WORDS - 1)].op = OP_UNDECODED;
+    return -1;
+  }
+  if (a - IO_BASE < IO_SIZE) {
+    dev_write(s, a & ~3u, v << (8 * (a & 3)));
+    return -1;
+  }
+  return EXC_STORE_FAULT;
+}
+
+/* ---- CSRs ---- */
+
+/* Returns 0 for an unknown CSR or a write to a read-only one. */
+static int csr_access(struct sim *s, unsigned csr, uint32_t *old,
+                      uint32_t val, int write)
+{
+  if (write && (csr >> 10) == 3)
+    return 0;
+  switch (csr) {
+  case 0x300:   /* mstatus */
+    *old = s->mstatus;
+    if (write)
+      s->mstatus = (val & (MSTATUS_MIE | MSTATUS_MPIE)) | MSTATUS_MPP;
+    return 1;
+  case 0x301:   /* misa: RV32IM */
+    *old = 0x40001100u;
+    return 1;
+  case 0x304:   /* mie */
+    *old = s->mie;
+    if (write)
+      s->mie = val;
+    return 1;
+  case 0x305:   /* mtvec: direct or vectored */
+    *old = s->mtvec;
+    if (write)
+      s->mtvec = val & ~2u;
+    return 1;
+  case 0x340: *old = s->mscratch; if (write) s->mscratch = val; return 1;
+  case 0x341: *old = s->mepc;     if (write) s->mepc = val & ~3u; return 1;
+  case 0x342: *old = s->mcause;   if (write) s->mcause = val; return 1;
+  case 0x343: *old = s->mtval;    if (write) s->mtval = val; return 1;
+  case 0x344: *old = s->mip;      return 1;   /* pending bits come from devices */
+  case 0xB00: case 0xC00: case 0xC01:   /* mcycle, cycle, time */
+    *old = (uint32_t)(s->cycle + s->mcycle_adj);
+    if (write)
+      s->mcycle_adj = (((s->cycle + s->mcycle_adj) & 0xffffffff00000000ull) | val) - s->cycle;
+    return 1;
+  case 0xB80: case 0xC80: case 0xC81:
+    *old = (uint32_t)((s->cycle + s->mcycle_adj) >> 32);
+    if (write)
+      s->mcycle_adj = (((s->cycle + s->mcycle_adj) & 0xffffffffull) | (uint64_t)val << 32) - s->cycle;
+    return 1;
+  case 0xB02: case 0xC02:               /* minstret, instret */
+    *old = (uint32_t)s->instret;
+    if (write)
+      s->instret = (s->instret & 0xffffffff00000000ull) | val;
+    return 1;
+  case 0xB82: case 0xC82:
+    *old = (uint32_t)(s->instret >> 32);
+    if (write)
+      s->instret = (s->instret & 0xffffffffull) | (uint64_t)val << 32;
+    return 1;
+  case 0xF11: case 0xF12: case 0xF13: case 0xF14:   /* vendor/arch/imp/hart id */
+    *old = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/* Highest pending and enabled interrupt, or -1. */
+static int pending_irq(struct sim *s)
+{
+  uint32_t p = s->mip & s->mie;
+  int cause = 31;
+
+  if (p == 0)
+    return -1;
+  while (!(p & (1u << cause)))
+    cause--;
+  return cause;
+}
+
+/* The hart is waiting (wfi or a branch to itself). Skip ahead to the next
+   device event; returns 0 if nothing can ever wake it up. wfi wakes on a
+   pending enabled interrupt whatever mstatus.MIE says, but a branch to
+   itself only leaves through a trap, so with MIE clear even a pending
+   interrupt cannot end it. */
+static int idle(struct sim *s, int need_mie)
+{
+  if (need_mie && !(s->mstatus & MSTATUS_MIE))
+    return 0;
+  if (s->mip & s->mie)
+    return 1;
+  if (s->mie == 0)
+    return 0;
+  if (s->next_event == NO_EVENT)
+    return 0;
+  if (s->next_event > s->cycle)
+    s->cycle = s->next_event;
+  return 1;
+}
+
+/* Run until *stop is set, a limit is hit, or the program halts.
+   Returns 0 on stop/limit, 1 when the hart halted, 2 on ebreak. */
+int cpu_run(struct sim *s, volatile int *stop)
+{
+  uint32_t *x = s->x;
+
+  while (!*stop) {
+    struct insn *d;
+    uint32_t pc = s->pc, npc = pc + 4, v;
+    unsigned cost = 1;
+    int exc = -1;
+
+    if (s->cycle >= s->next_event)
+      dev_update(s);
+    if ((s->mstatus & MSTATUS_MIE) && (s->mip & s->mie)) {
+      trap(s, 0x80000000u | (uint32_t)pending_irq(s), 0);
+      s->irqs++;
+      continue;
+    }
+    if (s->cycle >= s->max_cycles || s->instret >= s->max_insns)
+      return 0;
+
+    if (pc & 3) {
+      trap(s, EXC_INSN_MISALIGNED, pc);
+      continue;
+    }
+    if (pc >= RAM_SIZE) {
+      trap(s, EXC_INSN_FAULT, pc);
+      continue;
+    }
+    d = fetch(s, pc);
+    if (s->trace)
+      fprintf(stderr, "%10llu %08x op=%u rd=%u rs1=%u rs2=%u imm=%d\n",
+              (unsigned long long)s->cycle, pc, d->op, d->rd, d->rs1, d->rs2, d->imm);
+
+    uint32_t a = x[d->rs1], b = x[d->rs2];
+    switch (d->op) {
+    case OP_LUI:   x[d->rd] = (uint32_t)d->imm; break;
+    case OP_AUIPC: x[d->rd] = pc + (uint32_t)d->imm; break;
+    case OP_JAL:
+      x[d->rd] = npc;
+      npc = pc + (uint32_t)d->imm;
+      cost = COST_JUMP;
+      if (d->imm == 0 && !idle(s, 1))
+        return 1;
+      break;
+    case OP_JALR:
+      x[d->rd] = npc;
+      npc = (a + (uint32_t)d->imm) & ~1u;
+      cost = COST_JUMP;
+      break;
+#define BRANCH(cond) if (cond) { npc = pc + (uint32_t)d->imm; cost = COST_JUMP; \
+                       if (d->imm == 0 && !idle(s, 1)) return 1; } break
+    case OP_BEQ:  BRANCH(a == b);
+    case OP_BNE:  BRANCH(a != b);
+    case OP_BLT:  BRANCH((int32_t)a < (int32_t)b);
+    case OP_BGE:  BRANCH((int32_t)a >= (int32_t)b);
+    case OP_BLTU: BRANCH(a < b);
+    case OP_BGEU: BRANCH(a >= b);
+#undef BRANCH
+    case OP_LB:
+      if ((exc = load(s, a + (uint32_t)d->imm, 1, &v)) < 0) x[d->rd] = (uint32_t)(int8_t)v;
+      cost = COST_LOAD;
+      break;
+    case OP_LH:
+      if ((exc = load(s, a + (uint32_t)d->imm, 2, &v)) < 0) x[d->rd] = (uint32_t)(int16_t)v;
+      cost = COST_LOAD;
+      break;
+    case OP_LW:
+      if ((exc = load(s, a + (uint32_t)d->imm, 4, &v)) < 0) x[d->rd] = v;
+      cost = COST_LOAD;
+      break;
+    case OP_LBU:
+      if ((exc = load(s, a + (uint32_t)d->imm, 1, &v)) < 0) x[d->rd] = v & 0xff;
+      cost = COST_LOAD;
+      break;
+    case OP_LHU:
+      if ((exc = load(s, a + (uint32_t)d->imm, 2, &v)) < 0) x[d->rd] = v & 0xffff;
+      cost = COST_LOAD;
+      break;
+    case OP_SB: exc = store(s, a + (uint32_t)d->imm, 1, b & 0xff); break;
+    case OP_SH: exc = store(s, a + (uint32_t)d->imm, 2, b & 0xffff); break;
+    case OP_SW: exc = store(s, a + (uint32_t)d->imm, 4, b); break;
+    case OP_ADDI:  x[d->rd] = a + (uint32_t)d->imm; break;
+    case OP_SLTI:  x[d->rd] = (int32_t)a < d->imm; break;
+    case OP_SLTIU: x[d->rd] = a < (uint32_t)d->imm; break;
+    case OP_XORI:  x[d->rd] = a ^ (uint32_t)d->imm; break;
+    case OP_ORI:   x[d->rd] = a | (uint32_t)d->imm; break;
+    case OP_ANDI:  x[d->rd] = a & (uint32_t)d->imm; break;
+    case OP_SLLI:  x[d->rd] = a << d->imm; break;
+    case OP_SRLI:  x[d->rd] = a >> d->imm; break;
+    case OP_SRAI:  x[d->rd] = (uint32_t)((int32_t)a >> d->imm); break;
+    case OP_ADD:   x[d->rd] = a + b; break;
+    case OP_SUB:   x[d->rd] = a - b; break;
+    case OP_SLL:   x[d->rd] = a << (b & 31); break;
+    case OP_SLT:   x[d->rd] = (int32_t)a < (int32_t)b; break;
+    case OP_SLTU:  x[d->rd] = a < b; break;
+    case OP_XOR:   x[d->rd] = a ^ b; break;
+    case OP_SRL:   x[d->rd] = a >> (b & 31); break;
+    case OP_SRA:   x[d->rd] = (uint32_t)((int32_t)a >> (b & 31)); break;
+    case OP_OR:    x[d->rd] = a | b; break;
+    case OP_AND:   x[d->rd] = a & b; break;
+    case OP_MUL:   x[d->rd] = a * b; break;
+    case OP_MULH:
+      x[d->rd] = (uint32_t)((int64_t)(int32_t)a * (int32_t)b >> 32);
+      break;
+    case OP_MULHSU:
+      x[d->rd] = (uint32_t)((int64_t)(int32_t)a * (int64_t)(uint64_t)b >> 32);
+      break;
+    case OP_MULHU:
+      x[d->rd] = (uint32_t)((uint64_t)a * b >> 32);
+      break;
+    case OP_DIV:
+      x[d->rd] = b == 0 ? 0xffffffffu
+               : (a == 0x80000000u && b == 0xffffffffu) ? a
+               : (uint32_t)((int32_t)a / (int32_t)b);
+      cost = COST_DIV;
+      break;
+    case OP_DIVU:
+      x[d->rd] = b == 0 ? 0xffffffffu : a / b;
+      cost = COST_DIV;
+      break;
+    case OP_REM:
+      x[d->rd] = b == 0 ? a
+               : (a == 0x80000000u && b == 0xffffffffu) ? 0
+               : (uint32_t)((int32_t)a % (int32_t)b);
+      cost = COST_DIV;
+      break;
+    case OP_REMU:
+      x[d->rd] = b == 0 ? a : a % b;
+      cost = COST_DIV;
+      break;
+    case OP_FENCE:
+      break;
+    case OP_ECALL:
+      exc = EXC_ECALL_M;
+      break;
+    case OP_EBREAK:
+      return 2;
+    case OP_MRET:
+      s->mstatus = (s->mstatus & ~MSTATUS_MIE)
+                 | ((s->mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0)
+                 | MSTATUS_MPIE;
+      npc = s->mepc;
+      cost = COST_JUMP;
+      break;
+    case OP_WFI:
+      if (!idle(s, 0))
+        return 1;
+      break;
+    case OP_CSRRW: case OP_CSRRS: case OP_CSRRC:
+    case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI: {
+      uint32_t src = d->op >= OP_CSRRWI ? d->rs1 : a, old, val;
+      int kind = (d->op - OP_CSRRW) % 3;   /* 0 write, 1 set, 2 clear */
+      int write = kind == 0 || d->rs1 != 0;
+
+      if (!csr_access(s, (unsigned)d->imm, &old, 0, 0)) {
+        exc = EXC_ILLEGAL;
+        break;
+      }
+      val = kind == 0 ? src : kind == 1 ? (old | src) : (old & ~src);
+      if (write && !csr_access(s, (unsigned)d->imm, &old, val, 1)) {
+        exc = EXC_ILLEGAL;
+        break;
+      }
+      x[d->rd] = old;
+      break;
+    }
+    default:
+      exc = EXC_ILLEGAL;
+      break;
+    }
+    x[0] = 0;
+
+    if (exc >= 0) {
+      uint32_t tval = exc == EXC_ILLEGAL ? (d->op == OP_ILLEGAL ? (uint32_t)d->imm : 0)
+                    : exc == EXC_ECALL_M ? 0 : a + (uint32_t)d->imm;
+      s->cycle += cost;
+      trap(s, (uint32_t)exc, tval);
+      continue;
+    }
+    s->pc = npc;
+    s->cycle += cost;
+    s->instret++;
+  }
+  return 0;
+}
@@ -0,0 +1,292 @@
+/* dev.c
+   DTEK-V memory-mapped devices: LEDs, switches and button (Intel PIO with
+   edge capture), the Intel interval timer, the JTAG UART and the six HEX
+   displays. Device time is the hart's cycle counter; the timer runs at the
+   CPU clock. Devices are brought up to date lazily, either when they are
+   accessed or when the cycle counter reaches s->next_event. */
+
+#include <stdio.h>
+#include "dtekv-sim.h"
+
+/* timer registers and bits */
+#define TMR_STATUS   0x00
+#define TMR_CONTROL  0x04
+#define TMR_PERIODL  0x08
+#define TMR_PERIODH  0x0C
+#define TMR_SNAPL    0x10
+#define TMR_SNAPH    0x14
+#define ST_TO        (1u << 0)
+#define ST_RUN       (1u << 1)
+#define CTRL_ITO     (1u << 0)
+#define CTRL_CONT    (1u << 1)
+#define CTRL_START   (1u << 2)
+#define CTRL_STOP    (1u << 3)
+
+/* JTAG UART control bits */
+#define UART_RE      (1u << 0)
+#define UART_WE      (1u << 1)
+#define UART_WI      (1u << 9)
+
+/* PIO registers */
+#define PIO_DATA     0x0
+#define PIO_DIR      0x4
+#define PIO_IMASK    0x8
+#define PIO_ECAP     0xC
+
+void dev_init(struct sim *s)
+{
+  s->tmr_period = s->tmr_counter = 0xffffffffu;
+  s->next_event = NO_EVENT;
+  for (int i = 0; i < HEX_COUNT; i++)
+    s->hex[i] = 0xff;
+  if (s->uart_irq == 0)
+    s->uart_irq = IRQ_UART_DEF;
+}
+
+/* ---- interval timer ---- */
+
+static void timer_sync(struct sim *s)
+{
+  uint64_t len;
+
+  if (!s->tmr_running || s->cycle < s->tmr_expire)
+    return;
+  s->tmr_to = 1;
+  if (s->tmr_control & CTRL_CONT) {
+    len = (uint64_t)s->tmr_period + 1;
+    s->tmr_expire += len * ((s->cycle - s->tmr_expire) / len + 1);
+  } else {
+    s->tmr_running = 0;
+    s->tmr_counter = s->tmr_period;
+  }
+}
+
+static uint32_t timer_count(struct sim *s)
+{
+  if (!s->tmr_running)
+    return s->tmr_counter;
+  return (uint32_t)(s->tmr_expire - s->cycle - 1);
+}
+
+static void timer_start(struct sim *s)
+{
+  s->tmr_running = 1;
+  s->tmr_expire = s->cycle + (uint64_t)s->tmr_counter + 1;
+}
+
+/* ---- JTAG UART ---- */
+
+static void uart_sync(struct sim *s)
+{
+  uint64_t n;
+
+  if (s->uart_fifo == 0 || s->uart_cpb == 0) {
+    s->uart_fifo = 0;
+    s->uart_last = s->cycle;
+    return;
+  }
+  n = (s->cycle - s->uart_last) / s->uart_cpb;
+  if (n >= s->uart_fifo) {
+    s->uart_fifo = 0;
+    s->uart_last = s->cycle;
+  } else {
+    s->uart_fifo -= (unsigned)n;
+    s->uart_last += n * s->uart_cpb;
+  }
+}
+
+/* ---- GPIO ---- */
+
+static const char *hex_glyph(uint32_t seg)
+{
+  static const struct { uint8_t seg; char c; } map[] = {
+    { 0x40, '0' }, { 0x79, '1' }, { 0x24, '2' }, { 0x30, '3' }, { 0x19, '4' },
+    { 0x12, '5' }, { 0x02, '6' }, { 0x78, '7' }, { 0x00, '8' }, { 0x10, '9' },
+    { 0x08, 'A' }, { 0x03, 'b' }, { 0x46, 'C' }, { 0x21, 'd' }, { 0x06, 'E' },
+    { 0x0E, 'F' }, { 0x7F, ' ' }, { 0x3F, '-' }, { 0x09, 'H' }, { 0x47, 'L' },
+    { 0x0C, 'P' }, { 0x41, 'U' }, { 0x2B, 'n' }, { 0x23, 'o' }, { 0x2F, 'r' },
+    { 0x07, 't' }, { 0x11, 'y' }
+  };
+  static char out[2];
+
+  for (unsigned i = 0; i < sizeof(map) / sizeof(map[0]); i++)
+    if ((seg & 0x7f) == map[i].seg) {
+      out[0] = map[i].c;
+      return out;
+    }
+  return "?";
+}
+
+static void hex_show(struct sim *s)
+{
+  fprintf(stderr, "[%12llu] HEX ", (unsigned long long)s->cycle);
+  for (int i = HEX_COUNT - 1; i >= 0; i--) {
+    fputs(hex_glyph(s->hex[i]), stderr);
+    if (!(s->hex[i] & 0x80))
+      fputc('.', stderr);
+  }
+  fputc('\n', stderr);
+}
+
+static void pio_input(struct pio *p, uint32_t value)
+{
+  p->ecap |= p->data ^ value;
+  p->data = value;
+}
+
+static void input_sync(struct sim *s)
+{
+  while (s->next_input < s->n_events && s->events[s->next_input].cycle <= s->cycle) {
+    struct input_event *e = &s->events[s->next_input++];
+    pio_input(e->btn ? &s->btn : &s->sw, e->value);
+  }
+}
+
+static void pio_write(struct pio *p, uint32_t reg, uint32_t val)
+{
+  switch (reg) {
+  case PIO_DIR:   p->dir = val; break;
+  case PIO_IMASK: p->imask = val; break;
+  case PIO_ECAP:  p->ecap &= ~val; break;
+  }
+}
+
+static uint32_t pio_read(struct pio *p, uint32_t reg)
+{
+  switch (reg) {
+  case PIO_DATA:  return p->data;
+  case PIO_DIR:   return p->dir;
+  case PIO_IMASK: return p->imask;
+  case PIO_ECAP:  return p->ecap;
+  }
+  return 0;
+}
+
+/* ---- common ---- */
+
+/* Recompute mip and the cycle of the next device event. */
+static void dev_irq(struct sim *s)
+{
+  uint32_t mip = 0;
+  uint64_t next = NO_EVENT;
+
+  if (s->tmr_to && (s->tmr_control & CTRL_ITO))
+    mip |= 1u << IRQ_TIMER;
+  if (s->sw.ecap & s->sw.imask)
+    mip |= 1u << IRQ_SW;
+  if (s->btn.ecap & s->btn.imask)
+    mip |= 1u << IRQ_BTN;
+  if ((s->uart_ctrl & UART_WE) && s->uart_fifo < UART_FIFO)
+    mip |= 1u << s->uart_irq;
+  s->mip = mip;
+
+  if (s->tmr_running)
+    next = s->tmr_expire;
+  if (s->uart_fifo != 0 && s->uart_cpb != 0 && s->uart_last + s->uart_cpb < next)
+    next = s->uart_last + s->uart_cpb;
+  if (s->next_input < s->n_events && s->events[s->next_input].cycle < next)
+    next = s->events[s->next_input].cycle;
+  s->next_event = next;
+}
+
+void dev_update(struct sim *s)
+{
+  timer_sync(s);
+  uart_sync(s);
+  input_sync(s);
+  dev_irq(s);
+}
+
+uint32_t dev_read(struct sim *s, uint32_t addr)
+{
+  uint32_t v = 0;
+
+  dev_update(s);
+  if (addr == LED_BASE) {
+    v = s->leds;
+  } else if (addr - SW_BASE < 0x10) {
+    v = pio_read(&s->sw, addr - SW_BASE);
+  } else if (addr - BTN_BASE < 0x10) {
+    v = pio_read(&s->btn, addr - BTN_BASE);
+  } else if (addr - TIMER_BASE < 0x20) {
+    switch (addr - TIMER_BASE) {
+    case TMR_STATUS:  v = (s->tmr_to ? ST_TO : 0) | (s->tmr_running ? ST_RUN : 0); break;
+    case TMR_CONTROL: v = s->tmr_control & (CTRL_ITO | CTRL_CONT); break;
+    case TMR_PERIODL: v = s->tmr_period & 0xffff; break;
+    case TMR_PERIODH: v = s->tmr_period >> 16; break;
+    case TMR_SNAPL:   v = s->tmr_snap & 0xffff; break;
+    case TMR_SNAPH:   v = s->tmr_snap >> 16; break;
+    }
+  } else if (addr == UART_BASE) {
+    v = 0;                              /* no input: RVALID clear */
+  } else if (addr == UART_BASE + 4) {
+    uint32_t space = UART_FIFO - s->uart_fifo;
+    v = (space << 16) | (s->uart_ctrl & (UART_RE | UART_WE));
+    if ((s->uart_ctrl & UART_WE) && space != 0)
+      v |= UART_WI;
+  } else if (addr - HEX_BASE < HEX_COUNT * HEX_STRIDE && (addr & 0xf) == 0) {
+    v = s->hex[(addr - HEX_BASE) / HEX_STRIDE];
+  }
+  return v;
+}
+
+void dev_write(struct sim *s, uint32_t addr, uint32_t val)
+{
+  dev_update(s);
+  if (addr == LED_BASE) {
+    val &= 0x3ff;
+    if (s->show_leds && val != s->leds)
+      fprintf(stderr, "[%12llu] LEDS 0x%03x\n", (unsigned long long)s->cycle, val);
+    s->leds = val;
+  } else if (addr - SW_BASE < 0x10) {
+    pio_write(&s->sw, addr - SW_BASE, val);
+  } else if (addr - BTN_BASE < 0x10) {
+    pio_write(&s->btn, addr - BTN_BASE, val);
+  } else if (addr - TIMER_BASE < 0x20) {
+    switch (addr - TIMER_BASE) {
+    case TMR_STATUS:
+      s->tmr_to = 0;
+      break;
+    case TMR_CONTROL:
+      s->tmr_control = val & (CTRL_ITO | CTRL_CONT);
+      if ((val & CTRL_STOP) && s->tmr_running) {
+        s->tmr_counter = timer_count(s);
+        s->tmr_running = 0;
+      }
+      if ((val & CTRL_START) && !s->tmr_running)
+        timer_start(s);
+      break;
+    case TMR_PERIODL:
+    case TMR_PERIODH:
+      /* writing the period stops the timer and reloads the counter */
+      if (addr - TIMER_BASE == TMR_PERIODL)
+        s->tmr_period = (s->tmr_period & 0xffff0000u) | (val & 0xffff);
+      else
+        s->tmr_period = (s->tmr_period & 0xffffu) | (val << 16);
+      s->tmr_running = 0;
+      s->tmr_counter = s->tmr_period;
+      break;
+    case TMR_SNAPL:
+    case TMR_SNAPH:
+      s->tmr_snap = timer_count(s);
+      break;
+    }
+  } else if (addr == UART_BASE) {
+    if (s->uart_fifo < UART_FIFO) {
+      if (s->uart_fifo == 0)
+        s->uart_last = s->cycle;
+      s->uart_fifo++;
+      putchar((int)(val & 0xff));
+    }
+  } else if (addr == UART_BASE + 4) {
+    s->uart_ctrl = val & (UART_RE | UART_WE);
+  } else if (addr - HEX_BASE < HEX_COUNT * HEX_STRIDE && (addr & 0xf) == 0) {
+    unsigned n = (addr - HEX_BASE) / HEX_STRIDE;
+    if (s->show_hex && (val & 0xff) != s->hex[n]) {
+      s->hex[n] = val & 0xff;
+      hex_show(s);
+    }
+    s->hex[n] = val & 0xff;
+  }
+  dev_irq(s);
+}
@@ -0,0 +1,140 @@
+/* dtekv-sim.h
+   Host-side simulator for the DTEK-V board: an RV32IM + Zicsr hart in
+   machine mode, 32 MiB of RAM at address 0, and models of the memory
+   mapped devices used by the Lab3 programs. */
+
+#ifndef DTEKV_SIM_H
+#define DTEKV_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define RAM_SIZE      (32u << 20)
+#define PAGE_SHIFT    12
+#define PAGE_WORDS    (1u << (PAGE_SHIFT - 2))
+
+/* Memory-mapped I/O */
+#define IO_BASE       0x04000000u
+#define IO_SIZE       0x00000100u
+#define LED_BASE      0x04000000u
+#define SW_BASE       0x04000010u
+#define TIMER_BASE    0x04000020u
+#define UART_BASE     0x04000040u
+#define HEX_BASE      0x04000050u
+#define HEX_STRIDE    0x10u
+#define HEX_COUNT     6
+#define BTN_BASE      0x040000D0u
+
+/* Interrupt causes (mcause without the interrupt bit) */
+#define IRQ_TIMER     16
+#define IRQ_SW        17
+#define IRQ_BTN       18
+#define IRQ_UART_DEF  19
+
+/* mstatus bits */
+#define MSTATUS_MIE   (1u << 3)
+#define MSTATUS_MPIE  (1u << 7)
+#define MSTATUS_MPP   (3u << 11)
+
+/* Exception causes */
+#define EXC_INSN_MISALIGNED  0
+#define EXC_INSN_FAULT       1
+#define EXC_ILLEGAL          2
+#define EXC_BREAKPOINT       3
+#define EXC_LOAD_MISALIGNED  4
+#define EXC_LOAD_FAULT       5
+#define EXC_STORE_MISALIGNED 6
+#define EXC_STORE_FAULT      7
+#define EXC_ECALL_M          11
+
+/* Default cycle costs; everything not listed takes one cycle. */
+#define COST_LOAD     2
+#define COST_JUMP     3     /* taken branches and jumps refill the pipeline */
+#define COST_DIV      33    /* iterative divider */
+
+#define UART_FIFO     64
+#define NO_EVENT      UINT64_MAX
+
+/* Predecoded instruction */
+struct insn {
+  uint8_t op;
+  uint8_t rd, rs1, rs2;
+  int32_t imm;
+};
+
+enum {
+  OP_UNDECODED = 0, OP_ILLEGAL,
+  OP_LUI, OP_AUIPC, OP_JAL, OP_JALR,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+  OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU, OP_SB, OP_SH, OP_SW,
+  OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI,
+  OP_SLLI, OP_SRLI, OP_SRAI,
+  OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA,
+  OP_OR, OP_AND,
+  OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+  OP_FENCE, OP_ECALL, OP_EBREAK, OP_MRET, OP_WFI,
+  OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI
+};
+
+struct input_event {
+  uint64_t cycle;
+  int btn;              /* 0: switches, 1: button */
+  uint32_t value;
+};
+
+struct pio {
+  uint32_t data, dir, imask, ecap;
+};
+
+struct sim {
+  /* hart */
+  uint32_t x[32];
+  uint32_t pc;
+  uint64_t cycle, instret;     /* cycle is also the device time base */
+  uint64_t mcycle_adj;          /* mcycle = cycle + mcycle_adj, for writes */
+  uint32_t mstatus, mie, mip, mtvec, mepc, mcause, mtval, mscratch;
+
+  uint8_t *ram;
+  struct insn *icache[RAM_SIZE >> PAGE_SHIFT];
+  uint64_t next_event;
+
+  /* interval timer */
+  uint32_t tmr_period, tmr_counter, tmr_snap;
+  uint32_t tmr_control;
+  int tmr_to, tmr_running;
+  uint64_t tmr_expire;
+
+  /* JTAG UART */
+  uint32_t uart_ctrl;         /* RE/WE */
+  unsigned uart_fifo;
+  uint64_t uart_last;
+  unsigned uart_cpb;          /* cycles per byte drained from the FIFO */
+  int uart_irq;
+
+  /* GPIO */
+  uint32_t leds;
+  uint32_t hex[HEX_COUNT];
+  struct pio sw, btn;
+  struct input_event *events;
+  unsigned n_events, next_input;
+
+  /* options */
+  int show_hex, show_leds, trace;
+  uint64_t max_cycles, max_insns;
+
+  /* statistics */
+  uint64_t traps, irqs;
+  uint64_t insn_decoded;
+};
+
+/* cpu.c */
+void cpu_reset(struct sim *s, uint32_t entry);
+int cpu_run(struct sim *s, volatile int *stop);
+
+/* dev.c */
+void dev_init(struct sim *s);
+uint32_t dev_read(struct sim *s, uint32_t addr);
+void dev_write(struct sim *s, uint32_t addr, uint32_t val);
+void dev_update(struct sim *s);
+
+#endif
@@ -0,0 +1,233 @@
+/* main.c
+   dtekv-sim: run a Lab3 main.elf or main.bin without the board.
+
+   The image is loaded at address 0 as laid out by dtekv-script.lds. JTAG
+   UART output goes to stdout; HEX/LED changes and statistics go to
+   stderr. The simulation ends on a limit, Ctrl-C, ebreak, or when the
+   program parks itself in a loop that no interrupt can leave. */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dtekv-sim.h"
+
+static volatile int stop_flag;
+
+static void on_sigint(int sig)
+{
+  (void)sig;
+  stop_flag = 1;
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+    "usage: dtekv-sim [options] main.elf|main.bin\n"
+    "  -c, --max-cycles N     stop after N cycles\n"
+    "  -n, --max-insns N      stop after N retired instructions\n"
+    "  --ips                  report host instructions/second once a second\n"
+    "  --hex                  print the HEX displays whenever they change\n"
+    "  --leds                 print the LEDs whenever they change\n"
+    "  --sw VALUE             initial switch positions\n"
+    "  --event CYCLE:sw=V     set the switches at CYCLE (repeatable)\n"
+    "  --event CYCLE:btn=V    set the button at CYCLE (repeatable)\n"
+    "  --uart-cpb N           cycles per byte drained from the UART FIFO (300)\n"
+    "  --uart-irq N           interrupt cause of the JTAG UART (19)\n"
+    "  --entry ADDR           start address (ELF entry, or 0x4 for .bin)\n"
+    "  --trace                trace every instruction on stderr\n");
+  exit(2);
+}
+
+static uint64_t num(const char *arg)
+{
+  char *end;
+  uint64_t v = strtoull(arg, &end, 0);
+
+  if (*arg == '\0' || *end != '\0') {
+    fprintf(stderr, "dtekv-sim: bad number '%s'\n", arg);
+    exit(2);
+  }
+  return v;
+}
+
+static void add_event(struct sim *s, const char *arg)
+{
+  struct input_event e;
+  const char *colon = strchr(arg, ':');
+
+  if (colon == NULL)
+    usage();
+  e.cycle = strtoull(arg, NULL, 0);
+  if (strncmp(colon + 1, "sw=", 3) == 0) {
+    e.btn = 0;
+    e.value = (uint32_t)num(colon + 4);
+  } else if (strncmp(colon + 1, "btn=", 4) == 0) {
+    e.btn = 1;
+    e.value = (uint32_t)num(colon + 5);
+  } else {
+    usage();
+  }
+  s->events = realloc(s->events, (s->n_events + 1) * sizeof(e));
+  if (s->events == NULL) {
+    perror("dtekv-sim");
+    exit(1);
+  }
+  /* keep the list sorted by cycle */
+  unsigned i = s->n_events++;
+  while (i > 0 && s->events[i - 1].cycle > e.cycle) {
+    s->events[i] = s->events[i - 1];
+    i--;
+  }
+  s->events[i] = e;
+}
+
+static uint32_t rd16(const uint8_t *p) { return (uint32_t)p[0] | (uint32_t)p[1] << 8; }
+static uint32_t rd32(const uint8_t *p) { return rd16(p) | rd16(p + 2) << 16; }
+
+/* Load an ELF32 RISC-V executable or a raw binary at address 0.
+   Returns the entry point. */
+static uint32_t load_image(struct sim *s, const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  uint8_t *buf;
+  long size;
+  uint32_t entry;
+
+  if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0) {
+    perror(path);
+    exit(1);
+  }
+  rewind(f);
+  buf = malloc(size ? (size_t)size : 1);
+  if (buf == NULL || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+    perror(path);
+    exit(1);
+  }
+  fclose(f);
+
+  if (size >= 52 && memcmp(buf, "\177ELF", 4) == 0) {
+    uint32_t phoff = rd32(buf + 28);
+    unsigned phentsize = rd16(buf + 42), phnum = rd16(buf + 44);
+
+    if (buf[4] != 1 || buf[5] != 1 || rd16(buf + 18) != 243) {
+      fprintf(stderr, "%s: not a 32-bit little-endian RISC-V ELF\n", path);
+      exit(1);
+    }
+    for (unsigned i = 0; i < phnum; i++) {
+      const uint8_t *ph = buf + phoff + i * phentsize;
+      uint32_t off, paddr, filesz, memsz;
+
+      if ((long)(phoff + (i + 1) * phentsize) > size)
+        break;
+      if (rd32(ph) != 1)                /* PT_LOAD */
+        continue;
+      off = rd32(ph + 4);
+      paddr = rd32(ph + 12);
+      filesz = rd32(ph + 16);
+      memsz = rd32(ph + 20);
+      if (paddr > RAM_SIZE || memsz > RAM_SIZE - paddr || filesz > memsz
+          || (long)off + (long)filesz > size) {
+        fprintf(stderr, "%s: segment at 0x%08x does not fit in RAM\n", path, paddr);
+        exit(1);
+      }
+      memcpy(s->ram + paddr, buf + off, filesz);
+      memset(s->ram + paddr + filesz, 0, memsz - filesz);
+    }
+    entry = rd32(buf + 24);
+  } else {
+    if ((unsigned long)size > RAM_SIZE) {
+      fprintf(stderr, "%s: image larger than RAM\n", path);
+      exit(1);
+    }
+    memcpy(s->ram, buf, (size_t)size);
+    entry = 4;                          /* boot.S: the hard-reset jump */
+  }
+  free(buf);
+  return entry;
+}
+
+static double now_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  static struct sim sim;
+  struct sim *s = &sim;
+  const char *image = NULL, *entry_arg = NULL;
+  int ips = 0, rc;
+  uint64_t max_cycles = UINT64_MAX, max_insns = UINT64_MAX;
+  double t0, t1;
+
+  s->uart_cpb = 300;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if ((!strcmp(a, "-c") || !strcmp(a, "--max-cycles")) && v) { max_cycles = num(v); i++; }
+    else if ((!strcmp(a, "-n") || !strcmp(a, "--max-insns")) && v) { max_insns = num(v); i++; }
+    else if (!strcmp(a, "--ips")) ips = 1;
+    else if (!strcmp(a, "--hex")) s->show_hex = 1;
+    else if (!strcmp(a, "--leds")) s->show_leds = 1;
+    else if (!strcmp(a, "--sw") && v) { s->sw.data = (uint32_t)num(v); i++; }
+    else if (!strcmp(a, "--event") && v) { add_event(s, v); i++; }
+    else if (!strcmp(a, "--uart-cpb") && v) { s->uart_cpb = (unsigned)num(v); i++; }
+    else if (!strcmp(a, "--uart-irq") && v) { s->uart_irq = (int)num(v); i++; }
+    else if (!strcmp(a, "--entry") && v) { entry_arg = v; i++; }
+    else if (!strcmp(a, "--trace")) s->trace = 1;
+    else if (a[0] == '-' || image != NULL) usage();
+    else image = a;
+  }
+  if (image == NULL)
+    usage();
+
+  s->ram = calloc(1, RAM_SIZE);
+  if (s->ram == NULL) {
+    perror("dtekv-sim");
+    return 1;
+  }
+  dev_init(s);
+  uint32_t entry = load_image(s, image);
+  cpu_reset(s, entry_arg ? (uint32_t)num(entry_arg) : entry);
+  dev_update(s);
+  signal(SIGINT, on_sigint);
+
+  /* Run in slices so that --ips can report while the program runs. */
+  t0 = now_sec();
+  for (;;) {
+    double ts = now_sec();
+    uint64_t i0 = s->instret;
+
+    s->max_cycles = max_cycles;
+    s->max_insns = ips && max_insns - s->instret > 20000000 ? s->instret + 20000000 : max_insns;
+    rc = cpu_run(s, &stop_flag);
+    if (rc != 0 || stop_flag || s->cycle >= max_cycles || s->instret >= max_insns)
+      break;
+    if (ips) {
+      t1 = now_sec();
+      fprintf(stderr, "[%12llu] %.1f MIPS\n", (unsigned long long)s->cycle,
+              (double)(s->instret - i0) / (t1 - ts) / 1e6);
+    }
+  }
+  t1 = now_sec();
+  fflush(stdout);
+
+  if (rc == 1)
+    fprintf(stderr, "\ndtekv-sim: halted at pc=0x%08x (nothing left to wake the hart)\n", s->pc);
+  else if (rc == 2)
+    fprintf(stderr, "\ndtekv-sim: ebreak at pc=0x%08x\n", s->pc);
+  fprintf(stderr,
+          "dtekv-sim: cycles=%llu instret=%llu cpi=%.3f traps=%llu irqs=%llu decoded=%llu\n"
+          "dtekv-sim: host %.3f s, %.2f MIPS, %.2fx real time at %u MHz\n",
+          (unsigned long long)s->cycle, (unsigned long long)s->instret,
+          s->instret ? (double)s->cycle / (double)s->instret : 0.0,
+          (unsigned long long)s->traps, (unsigned long long)s->irqs,
+          (unsigned long long)s->insn_decoded,
+          t1 - t0, (double)s->instret / (t1 - t0) / 1e6,
+          (double)s->cycle / 30e6 / (t1 - t0), 30u);
+  return rc == 2 ? 3 : 0;
+}
@@ -0,0 +1,256 @@
+/* dtekv-bcd.c
+   Packed BCD arithmetic on whole words.
+
+   Addition biases every digit by 16 - radix (6 for a decimal digit), so
+   that a digit sum that reaches its radix carries out of its nibble in
+   the ordinary binary add. The carries into each nibble are then read
+   back from a ^ b ^ sum, and the bias is taken off again from every
+   digit that did not carry. */
+
+#include "dtekv-bcd.h"
+
+#define BCD_DEC_BIAS 0x66666666u
+#define BCD_NINES    0x99999999u
+
+const struct bcd_clock bcd_clock_24h = BCD_CLOCK_HHMMSS(0x24);
+const struct bcd_clock bcd_clock_100h = BCD_CLOCK_HHMMSS(0x100);
+
+/* a + b + cin with per-digit radices given by bias. a + bias must not
+   carry out of any nibble, which holds for valid digits. */
+static inline unsigned bcd_add_biased(unsigned a, unsigned b, unsigned cin,
+                                      unsigned bias)
+{
+  unsigned t1 = a + bias;
+  unsigned t2 = t1 + b + cin;
+  unsigned carry = t1 ^ b ^ t2;                   /* carry into each bit */
+  unsigned out = ((carry >> 4) & 0x01111111u)     /* out of nibbles 0..6 */
+               | ((unsigned)(t2 < t1) << 28);     /* and out of nibble 7 */
+  unsigned kept = out ^ 0x11111111u;              /* nibbles that did not */
+
+  return t2 - (((kept << 4) - kept) & bias);
+}
+
+unsigned bcd_add(unsigned a, unsigned b)
+{
+  return bcd_add_biased(a, b, 0, BCD_DEC_BIAS);
+}
+
+/* ten's complement: a - b = a + (99999999 - b) + 1 */
+unsigned bcd_sub(unsigned a, unsigned b)
+{
+  return bcd_add_biased(a, BCD_NINES - b, 1, BCD_DEC_BIAS);
+}
+
+int bcd_valid(unsigned a)
+{
+  unsigned t = a + BCD_DEC_BIAS;
+  unsigned carry = t ^ a ^ BCD_DEC_BIAS;
+
+  return !((carry & 0x11111110u) | (unsigned)(t < a));
+}
+
+/* n / 10 by a constant compiles to mulhu and a shift. */
+unsigned bin2bcd(unsigned n)
+{
+  unsigned r = 0;
+
+  for (unsigned shift = 0; shift < 32; shift += 4) {
+    unsigned q = n / 10u;
+    r |= (n - q * 10u) << shift;
+    n = q;
+  }
+  return r;
+}
+
+/* Pairs of digits to bytes, bytes to halfwords, halfwords to the word. */
+unsigned bcd2bin(unsigned bcd)
+{
+  unsigned x = bcd;
+
+  x = (x & 0x0F0F0F0Fu) + ((x >> 4) & 0x0F0F0F0Fu) * 10u;
+  x = (x & 0x00FF00FFu) + ((x >> 8) & 0x00FF00FFu) * 100u;
+  return (x & 0xFFFFu) + (x >> 16) * 10000u;
+}
+
+/* The sum stays below 2 * wrap, so one conditional subtraction wraps it;
+   the condition selects with a mask rather than a branch. */
+unsigned bcd_clock_add(unsigned t, unsigned d, const struct bcd_clock *c)
+{
+  unsigned r = bcd_add_biased(t, d, 0, c->bias);
+  unsigned w = bcd_add_biased(r, BCD_NINES - c->wrap, 1, BCD_DEC_BIAS);
+  unsigned m = 0u - (unsigned)(r >= c->wrap);
+
+  return r ^ ((r ^ w) & m);
+}
+
+#ifdef DTEKV_BENCH
+#include "dtekv-lib.h"
+
+static void bcd_report(const char *what, unsigned cases, unsigned bad)
+{
+  print("bcd_selftest: ");
+  print(what);
+  print(bad ? " FAILED, mismatches=" : " ok, cases=");
+  print_dec(bad ? bad : cases);
+  print("\n");
+}
+
+/* Walk clock c through all of its values from 0 and compare each with
+   the time built from a binary count of seconds. */
+static unsigned bcd_clock_walk(const struct bcd_clock *c, unsigned hours,
+                               unsigned *cases)
+{
+  unsigned t = 0, bad = 0, s = 0, m = 0, h = 0;
+
+  for (;;) {
+    unsigned want = bin2bcd(h) << 16 | bin2bcd(m) << 8 | bin2bcd(s);
+
+    if (t != want)
+      bad++;
+    t = bcd_clock_inc(t, c);
+    (*cases)++;
+    if (++s == 60) {
+      s = 0;
+      if (++m == 60) {
+        m = 0;
+        if (++h == hours)
+          break;
+      }
+    }
+  }
+  return bad + (t != 0);
+}
+
+/* function: bcd_selftest
+   Description: every value of the 24 h, 100 h and MM:SS clocks, tick()
+   against the 100 h clock up to 9:59:59 (past it tick leaves BCD),
+   bin2bcd/bcd2bin over 0..999999 and a strided sweep up to 10^8, and
+   bcd_add/bcd_sub/bcd_cmp/bcd_valid on pseudo-random operands. */
+void bcd_selftest(void)
+{
+  static const struct bcd_clock mmss = BCD_CLOCK_MMSS;
+  unsigned bad = 0, cases = 0, seed = 12345u;
+
+  bad += bcd_clock_walk(&bcd_clock_24h, 24, &cases);
+  bad += bcd_clock_walk(&bcd_clock_100h, 100, &cases);
+  bcd_report("clocks 24h/100h", cases, bad);
+
+  bad = 0;
+  cases = 0;
+  bad += bcd_clock_walk(&mmss, 1, &cases);
+  bcd_report("clock MM:SS", cases, bad);
+
+  bad = 0;
+  cases = 0;
+  for (unsigned t = 0; t < 0x95959u; t = bcd_clock_inc(t, &bcd_clock_100h)) {
+    int x = (int)t;
+    tick(&x);
+    if ((unsigned)x != bcd_clock_inc(t, &bcd_clock_100h))
+      bad++;
+    cases++;
+  }
+  bcd_report("tick vs bcd_clock_inc", cases, bad);
+
+  bad = 0;
+  cases = 0;
+  for (unsigned n = 0; n < 1000000u; n++, cases++)
+    if (bcd2bin(bin2bcd(n)) != n || !bcd_valid(bin2bcd(n)))
+      bad++;
+  for (unsigned n = 1000000u; n < 100000000u; n += 9973u, cases++)
+    if (bcd2bin(bin2bcd(n)) != n)
+      bad++;
+  bcd_report("bin2bcd/bcd2bin", cases, bad);
+
+  bad = 0;
+  cases = 0;
+  for (int i = 0; i < 100000; i++, cases++) {
+    unsigned a, b, sum, diff;
+
+    seed = seed * 1103515245u + 12345u;
+    a = seed % 100000000u;
+    seed = seed * 1103515245u + 12345u;
+    b = seed % 100000000u;
+    sum = a + b >= 100000000u ? a + b - 100000000u : a + b;
+    diff = a >= b ? a - b : a + 100000000u - b;
+    if (bcd_add(bin2bcd(a), bin2bcd(b)) != bin2bcd(sum)
+        || bcd_sub(bin2bcd(a), bin2bcd(b)) != bin2bcd(diff)
+        || bcd_cmp(bin2bcd(a), bin2bcd(b)) != (a > b) - (a < b))
+      bad++;
+  }
+  if (bcd_valid(0x0000000Au) || bcd_valid(0xA0000000u) || bcd_valid(0x00F00000u)
+      || !bcd_valid(0x99999999u))
+    bad++;
+  bcd_report("add/sub/cmp/valid", cases, bad);
+}
+
+#define BCD_BENCH_N 3600
+
+/* The digit split show_time() did before the clocks were BCD. */
+static unsigned bcd_ref_digits(int h, int m, int s)
+{
+  return (unsigned)(s % 10) | (unsigned)((s / 10) % 10) << 4
+       | (unsigned)(m % 10) << 8 | (unsigned)((m / 10) % 10) << 12
+       | (unsigned)(h % 10) << 16 | (unsigned)((h / 10) % 10) << 20;
+}
+
+/* function: bcd_bench
+   Description: mean cycles over an hour of seconds of tick(), of
+   bcd_clock_inc() (whose result is already the display digits), and of
+   the int clock with its /10 %10 digit split that the labs used before;
+   then bin2bcd and bcd2bin. */
+void bcd_bench(void)
+{
+  volatile unsigned sink = 0;
+  unsigned t0, c_tick, c_inc, c_split, c_b2b, c_b2n;
+  int x = 0, h = 0, m = 0, s = 0;
+  unsigned t = 0;
+
+  t0 = read_mcycle();
+  for (int i = 0; i < BCD_BENCH_N; i++)
+    tick(&x);
+  c_tick = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (int i = 0; i < BCD_BENCH_N; i++)
+    t = bcd_clock_inc(t, &bcd_clock_100h);
+  c_inc = read_mcycle() - t0;
+  sink = t;
+
+  t0 = read_mcycle();
+  for (int i = 0; i < BCD_BENCH_N; i++) {
+    if (++s >= 60) {
+      s = 0;
+      if (++m >= 60) {
+        m = 0;
+        if (++h >= 100)
+          h = 0;
+      }
+    }
+    sink = bcd_ref_digits(h, m, s);
+  }
+  c_split = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (unsigned i = 0; i < BCD_BENCH_N; i++)
+    sink = bin2bcd(i);
+  c_b2b = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (unsigned i = 0; i < BCD_BENCH_N; i++)
+    sink = bcd2bin(i);
+  c_b2n = read_mcycle() - t0;
+  (void)sink;
+
+  print("bcd_bench: cycles/call tick=");
+  print_dec(c_tick / BCD_BENCH_N);
+  print(" bcd_clock_inc=");
+  print_dec(c_inc / BCD_BENCH_N);
+  print(" int clock+/10%10 split=");
+  print_dec(c_split / BCD_BENCH_N);
+  print(" bin2bcd=");
+  print_dec(c_b2b / BCD_BENCH_N);
+  print(" bcd2bin=");
+  print_dec(c_b2n / BCD_BENCH_N);
+  print("\n");
+}
+#endif
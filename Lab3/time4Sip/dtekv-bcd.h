@@ -0,0 +1,67 @@
+#ifndef DTEKV_BCD_H
+#define DTEKV_BCD_H
+
+/* Packed BCD: eight decimal digits in a 32-bit word, least significant
+   digit in bits 3:0. Every operation works on all digits at once with
+   carry tricks on the whole word; none of them branches per digit.
+
+   Clocks are packed BCD too, HH:MM:SS as 0x00HHMMSS (MM:SS is the same
+   with the hours 0), so a display takes its digits straight from the
+   nibbles. Packed BCD values compare like the numbers they hold. */
+
+/* a + b and a - b modulo 10^8. */
+unsigned bcd_add(unsigned a, unsigned b);
+unsigned bcd_sub(unsigned a, unsigned b);
+
+static inline unsigned bcd_inc(unsigned a)
+{
+  return bcd_add(a, 1);
+}
+
+/* -1, 0 or 1 as a is below, equal to or above b. */
+static inline int bcd_cmp(unsigned a, unsigned b)
+{
+  return (a > b) - (a < b);
+}
+
+/* Nonzero if every nibble of a is a decimal digit. */
+int bcd_valid(unsigned a);
+
+/* n < 10^8 to packed BCD, and back. */
+unsigned bin2bcd(unsigned n);
+unsigned bcd2bin(unsigned bcd);
+
+/* A clock format: bias holds 16 - radix for every digit (6 for a decimal
+   digit, 0xA for the tens of seconds and minutes), wrap is the BCD value
+   at which the clock starts again from 0. */
+struct bcd_clock {
+  unsigned bias;
+  unsigned wrap;
+};
+
+/* HH:MM:SS wrapping after hours - 1 (hours in BCD, up to 0x100) and
+   MM:SS wrapping after 59:59. */
+#define BCD_CLOCK_HHMMSS(hours)  { 0x6666A6A6u, (unsigned)(hours) << 16 }
+#define BCD_CLOCK_MMSS           { 0x666666A6u, 0x6000u }
+
+extern const struct bcd_clock bcd_clock_24h;    /* 00:00:00 .. 23:59:59 */
+extern const struct bcd_clock bcd_clock_100h;   /* 00:00:00 .. 99:59:59 */
+
+/* t + d on clock c; both must be valid times below c->wrap. */
+unsigned bcd_clock_add(unsigned t, unsigned d, const struct bcd_clock *c);
+
+static inline unsigned bcd_clock_inc(unsigned t, const struct bcd_clock *c)
+{
+  return bcd_clock_add(t, 1, c);
+}
+
+/* The lab's own one-second step of *t, in timetemplate.S: the same as
+   bcd_clock_inc() on the 100 h clock up to 9:59:59. */
+void tick(int *t);
+
+#ifdef DTEKV_BENCH
+void bcd_selftest(void);
+void bcd_bench(void);
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef DTEKV_FIX_H
+#define DTEKV_FIX_H
+
+/* Fixed-point arithmetic, for what would otherwise be float code run
+   through softfloat.a on this core without an FPU.
+
+     fix16_t r = fix16_mul(FIX16(2.5), fix16_from_int(x));
+     fix16_t s, c;
+     fix16_sincos(FIX16_PI / 6, &s, &c);     s = 0.5, c = 0.866
+
+   fix16_t is Q16.16: a signed 32-bit word holding value * 65536, range
+   -32768 .. 32767.99998 in steps of 1/65536 (one LSB, about 1.5e-5).
+   q31_t is Q1.31, value * 2^31, for fractions in [-1, 1).
+
+   Results that do not fit saturate to FIX16_MAX / FIX16_MIN (Q31_MAX /
+   Q31_MIN) rather than wrap, and everything rounds to nearest. The
+   multiplies are a mul/mulh pair; nothing here divides 64-bit numbers.
+   Error bounds are against the exact result, in LSB, as measured
+   against libm over millions of inputs spread across the whole range. */
+
+typedef int fix16_t;
+typedef int q31_t;
+
+#define FIX16_ONE   0x00010000
+#define FIX16_MAX   0x7fffffff
+#define FIX16_MIN   (-0x7fffffff - 1)
+#define FIX16_PI    205887            /* pi, 3.14159 */
+#define FIX16_PI_2  102944            /* pi / 2 */
+#define FIX16_E     178145            /* e, 2.71828 */
+#define FIX16_LN2   45426             /* ln 2, 0.69315 */
+
+#define Q31_MAX     0x7fffffff
+#define Q31_MIN     (-0x7fffffff - 1)
+
+/* A constant: FIX16(0.25) is 0x4000. For literals only; a variable
+   argument would pull in softfloat. */
+#define FIX16(x)    ((fix16_t)((x) * 65536.0 + ((x) >= 0 ? 0.5 : -0.5)))
+
+static inline fix16_t fix16_sat(long long x)
+{
+  if (x > FIX16_MAX)
+    return FIX16_MAX;
+  if (x < FIX16_MIN)
+    return FIX16_MIN;
+  return (fix16_t)x;
+}
+
+static inline fix16_t fix16_from_int(int x)
+{
+  return fix16_sat((long long)x * FIX16_ONE);
+}
+
+/* Rounded to the nearest integer, halves away from zero. */
+static inline int fix16_to_int(fix16_t a)
+{
+  return a >= 0 ? (int)(((unsigned)a + 0x8000u) >> 16)
+                : -(int)((0x8000u - (unsigned)a) >> 16);
+}
+
+static inline fix16_t fix16_add(fix16_t a, fix16_t b)
+{
+  return fix16_sat((long long)a + b);
+}
+
+static inline fix16_t fix16_sub(fix16_t a, fix16_t b)
+{
+  return fix16_sat((long long)a - b);
+}
+
+/* a * b, rounded (0.5 LSB). */
+static inline fix16_t fix16_mul(fix16_t a, fix16_t b)
+{
+  return fix16_sat(((long long)a * b + 0x8000) >> 16);
+}
+
+/* a / b, rounded (0.5 LSB); b = 0 saturates to the sign of a. */
+fix16_t fix16_div(fix16_t a, fix16_t b);
+
+/* 1 / a with a single divu, rounded (0.5 LSB). */
+fix16_t fix16_recip(fix16_t a);
+
+/* Square root, rounded (0.5 LSB); 0 for a <= 0. */
+fix16_t fix16_sqrt(fix16_t a);
+
+/* Sine and cosine of an angle in radians by CORDIC, both at once.
+   Error 0.51 LSB for any angle. */
+void fix16_sincos(fix16_t angle, fix16_t *s, fix16_t *c);
+fix16_t fix16_sin(fix16_t angle);
+fix16_t fix16_cos(fix16_t angle);
+
+/* Angle of (x, y) in -pi .. pi by CORDIC; 0 for (0, 0). Error 0.51
+   LSB. */
+fix16_t fix16_atan2(fix16_t y, fix16_t x);
+
+/* e^x: range reduction by ln 2 and a degree-8 polynomial. Saturates above
+   x = 10.3972, 0 below -11.7835. Error 0.76 LSB for results below 4096,
+   1.2e-9 of the result (2.4 LSB at most) above. */
+fix16_t fix16_exp(fix16_t x);
+
+/* log2(a) and ln(a) by repeated squaring, one result bit per square.
+   FIX16_MIN for a <= 0. Error 0.5 LSB for log2, 0.55 for ln. */
+fix16_t fix16_log2(fix16_t a);
+fix16_t fix16_log(fix16_t a);
+
+/* Q1.31: a + b, a - b, a * b, saturating (only -1 * -1 can overflow). */
+static inline q31_t q31_add(q31_t a, q31_t b)
+{
+  long long s = (long long)a + b;
+  return s > Q31_MAX ? Q31_MAX : s < Q31_MIN ? Q31_MIN : (q31_t)s;
+}
+
+static inline q31_t q31_sub(q31_t a, q31_t b)
+{
+  long long s = (long long)a - b;
+  return s > Q31_MAX ? Q31_MAX : s < Q31_MIN ? Q31_MIN : (q31_t)s;
+}
+
+static inline q31_t q31_mul(q31_t a, q31_t b)
+{
+  long long p = ((long long)a * b + (1ll << 30)) >> 31;
+  return p > Q31_MAX ? Q31_MAX : (q31_t)p;
+}
+
+/* Q1.31 <-> Q16.16; to q31 saturates outside [-1, 1). */
+static inline q31_t q31_from_fix16(fix16_t a)
+{
+  return a >= FIX16_ONE ? Q31_MAX : a < -FIX16_ONE ? Q31_MIN : (q31_t)((unsigned)a << 15);
+}
+
+static inline fix16_t q31_to_fix16(q31_t a)
+{
+  return (fix16_t)(((long long)a + 0x4000) >> 15);
+}
+
+/* To and from the softfloat types, by taking the IEEE bits apart: no
+   softfloat call. Out of range and NaN saturate (NaN to 0); values
+   round to nearest, ties to even. */
+fix16_t fix16_from_float(float f);
+float fix16_to_float(fix16_t a);
+fix16_t fix16_from_double(double d);
+double fix16_to_double(fix16_t a);
+
+#ifdef DTEKV_BENCH
+void fix_bench(void);
+#endif
+
+#endif
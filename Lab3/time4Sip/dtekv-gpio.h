@@ -0,0 +1,62 @@
+#ifndef DTEKV_GPIO_H
+#define DTEKV_GPIO_H
+
+/* Debounced inputs: the ten switches and BTN2, as eleven pins.
+
+     gpio_init(GPIO_SWITCHES | GPIO_BIT(GPIO_BTN), 10);
+     ...
+     struct gpio_event ev;
+     while (gpio_read_event(&ev))
+       if (ev.pin == GPIO_BTN && ev.level)
+         button_pressed(ev.time);
+
+   Edges are latched by the PIO edge-capture registers. They are taken
+   from the switch and button interrupts when interrupts are enabled, and
+   otherwise by gpio_read_event() itself, so a polling lab gets the same
+   events. A pin reports its first edge at once and then ignores its
+   input for the debounce time; if the level it settles at differs from
+   the one reported, that is reported when the debounce time is over.
+   An edge that was latched but whose level is gone by the time it is
+   taken, such as a short press between two polls, is reported as both
+   of its edges. */
+
+#define GPIO_PINS   11
+#define GPIO_BTN    10                  /* pins 0..9 are SW1..SW10 */
+#define GPIO_BIT(pin)  (1u << (pin))
+#define GPIO_SWITCHES  0x3FFu
+
+/* Events waiting to be read; a power of two. */
+#ifndef GPIO_QUEUE_SIZE
+#define GPIO_QUEUE_SIZE 16
+#endif
+
+struct gpio_event {
+  unsigned time;                /* mcycle when the edge was taken */
+  unsigned char pin;
+  unsigned char level;          /* 1: switch on / button pressed */
+};
+
+struct gpio_stats {
+  unsigned edges;               /* edges latched by the hardware */
+  unsigned bounces;             /* of those, ignored while debouncing */
+  unsigned events;              /* events queued */
+  unsigned dropped;             /* events lost to a full queue */
+};
+
+/* Watch the pins in mask (GPIO_BIT(n)), debouncing each for debounce_ms,
+   and register the switch and button interrupts. Clears the queue. */
+void gpio_init(unsigned mask, unsigned debounce_ms);
+
+/* Take the next event into ev and return 1, or return 0 at once if there
+   is none. Also takes latched edges and ends debounce times. */
+int gpio_read_event(struct gpio_event *ev);
+
+/* The debounced level of every watched pin, bit n for pin n. */
+unsigned gpio_levels(void);
+
+/* Handler for IRQ_SWITCHES and IRQ_BUTTON, registered by gpio_init(). */
+void gpio_isr(unsigned cause, void *ctx);
+
+void gpio_get_stats(struct gpio_stats *st);
+
+#endif
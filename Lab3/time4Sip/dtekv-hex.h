@@ -0,0 +1,71 @@
+#ifndef DTEKV_HEX_H
+#define DTEKV_HEX_H
+
+/* Six-digit seven-segment display with a shadow framebuffer.
+
+     struct hex_frame f;
+     hex_frame_init(&f);
+     hex_frame_nibbles(&f, 0, 4, 0x5957);       HEX3..HEX0 = 5 9 5 7
+     hex_frame_glyph(&f, 4, HEX_BLANK);
+     hex_flush(&f);
+
+   A frame holds only the digits it sets. hex_flush() merges them into
+   the shadow copy of the display and writes the digits that changed,
+   all with interrupts masked, so a frame built in the main loop and one
+   built in an ISR never show half of each. HEX0 is the rightmost digit. */
+
+#define HEX_DIGITS 6
+
+/* Glyphs 0..15 are the hex digits; the rest follow. */
+enum hex_glyph {
+  HEX_BLANK = 16,
+  HEX_DASH,
+  HEX_H,
+  HEX_L,
+  HEX_P,
+  HEX_U,
+  HEX_n,
+  HEX_o,
+  HEX_r,
+  HEX_t,
+  HEX_y,
+  HEX_GLYPHS
+};
+
+/* Segment pattern of each glyph: bit n is segment a..g for n = 0..6,
+   bit 7 the decimal point; a 0 lights the segment. */
+extern const unsigned char hex_segments[HEX_GLYPHS];
+
+struct hex_frame {
+  unsigned char seg[HEX_DIGITS];
+  unsigned char set;            /* bit n: seg[n] is part of the frame */
+};
+
+struct hex_stats {
+  unsigned flushes;
+  unsigned writes;              /* digit registers written */
+};
+
+static inline void hex_frame_init(struct hex_frame *f)
+{
+  f->set = 0;
+}
+
+/* Put glyph on digit, decimal point off. Out-of-range digits and
+   glyphs are ignored and blank respectively. */
+void hex_frame_glyph(struct hex_frame *f, unsigned digit, unsigned glyph);
+
+/* Turn the decimal point of a digit already in the frame on or off. */
+void hex_frame_dp(struct hex_frame *f, unsigned digit, int on);
+
+/* Put count nibbles of value, least significant first, on the digits
+   from first up: BCD or plain hex. */
+void hex_frame_nibbles(struct hex_frame *f, unsigned first, unsigned count,
+                       unsigned value);
+
+/* Commit the frame to the display as one update. */
+void hex_flush(const struct hex_frame *f);
+
+void hex_get_stats(struct hex_stats *st);
+
+#endif
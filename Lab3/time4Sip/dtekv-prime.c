@@ -0,0 +1,298 @@
+/* dtekv-prime.c
+   Primality testing and nextprime(). Small numbers are trial-divided by the
+   integers coprime to 2*3*5*7 up to sqrt(n); larger ones go through
+   Miller-Rabin with bases 2, 7 and 61, which is exact for every n < 2^32.
+   The modular arithmetic is Montgomery multiplication on mul/mulhu, so no
+   64-bit division (and no libgcc helper) is needed. */
+
+#include "dtekv-prime.h"
+
+/* Residues mod 210 that are coprime to 210, and the distance from each one
+   to the next (the last gap wraps from 209 to 211). */
+static const unsigned char wheel_res[48] = {
+    1,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,
+   53,  59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103,
+  107, 109, 113, 121, 127, 131, 137, 139, 143, 149, 151, 157,
+  163, 167, 169, 173, 179, 181, 187, 191, 193, 197, 199, 209
+};
+static const unsigned char wheel_gap[48] = {
+  10, 2, 4, 2, 4, 6, 2, 6, 4, 2, 4, 6, 6, 2, 6, 4, 2, 6, 4, 6, 8, 4, 2, 4,
+   2, 4, 8, 6, 4, 6, 2, 4, 6, 2, 6, 6, 4, 2, 4, 6, 2, 6, 4, 2, 4, 2, 10, 2
+};
+
+/* Floor of the square root, bit by bit. */
+unsigned isqrt32(unsigned n)
+{
+  unsigned root = 0;
+  unsigned bit = 1u << 30;
+
+  while (bit > n)
+    bit >>= 2;
+  while (bit != 0) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/* n is coprime to 210 and at least 11: trial-divide by the wheel. */
+static int trial_wheel(unsigned n)
+{
+  unsigned limit = isqrt32(n);
+  unsigned d = 11;
+  unsigned i = 1;
+
+  while (d <= limit) {
+    if (n % d == 0)
+      return 0;
+    d += wheel_gap[i];
+    i = (i == 47) ? 0 : i + 1;
+  }
+  return 1;
+}
+
+/* -n^-1 mod 2^32 for odd n, by Newton iteration (3, 6, 12, 24, 48 bits). */
+static unsigned mont_ninv(unsigned n)
+{
+  unsigned x = n;
+  for (int i = 0; i < 4; i++)
+    x *= 2 - n * x;
+  return 0u - x;
+}
+
+/* a * b * 2^-32 mod n, for a, b < n and odd n. */
+static unsigned mont_mul(unsigned a, unsigned b, unsigned n, unsigned ninv)
+{
+  unsigned long long t = (unsigned long long)a * b;
+  unsigned m = (unsigned)t * ninv;
+  unsigned long long mn = (unsigned long long)m * n;
+  /* the low halves of t and m*n sum to 0 mod 2^32, with a carry unless
+     both are zero; the result is below 2n and may not fit 32 bits */
+  unsigned long long r = (t >> 32) + (mn >> 32) + ((unsigned)t != 0);
+
+  if (r >= n)
+    r -= n;
+  return (unsigned)r;
+}
+
+static unsigned mod_add(unsigned a, unsigned b, unsigned n)
+{
+  return a >= n - b ? a - (n - b) : a + b;
+}
+
+/* One strong-probable-prime round. one and mone are 1 and n-1 in
+   Montgomery form, n - 1 = d * 2^s with d odd. */
+static int mr_round(unsigned n, unsigned ninv, unsigned one, unsigned mone,
+                    unsigned base, unsigned d, unsigned s)
+{
+  unsigned b = 0, x = one;
+
+  /* base * 2^32 mod n, by doubling one */
+  for (int bit = 5; bit >= 0; bit--) {
+    b = mod_add(b, b, n);
+    if ((base >> bit) & 1)
+      b = mod_add(b, one, n);
+  }
+  for (; d != 0; d >>= 1) {
+    if (d & 1)
+      x = mont_mul(x, b, n, ninv);
+    b = mont_mul(b, b, n, ninv);
+  }
+  if (x == one || x == mone)
+    return 1;
+  while (--s != 0) {
+    x = mont_mul(x, x, n, ninv);
+    if (x == mone)
+      return 1;
+    if (x == one)
+      return 0;
+  }
+  return 0;
+}
+
+/* n is coprime to 210 and at least PRIME_MR_MIN. */
+static int miller_rabin(unsigned n)
+{
+  unsigned ninv = mont_ninv(n);
+  unsigned one = (0u - n) % n;     /* 2^32 mod n */
+  unsigned mone = n - one;
+  unsigned d = n - 1, s = 0;
+
+  while ((d & 1) == 0) {
+    d >>= 1;
+    s++;
+  }
+  return mr_round(n, ninv, one, mone, 2, d, s)
+      && mr_round(n, ninv, one, mone, 7, d, s)
+      && mr_round(n, ninv, one, mone, 61, d, s);
+}
+
+/* Test a number that is already known to be coprime to 210. */
+static int is_prime_wheeled(unsigned n)
+{
+  if (n < 121)
+    return n != 1;
+  if (n < PRIME_MR_MIN)
+    return trial_wheel(n);
+  return miller_rabin(n);
+}
+
+int is_prime_u32(unsigned n)
+{
+  if (n < 11)
+    return n == 2 || n == 3 || n == 5 || n == 7;
+  if ((n & 1) == 0 || n % 3 == 0 || n % 5 == 0 || n % 7 == 0)
+    return 0;
+  return is_prime_wheeled(n);
+}
+
+/*
+ * nextprime
+ *
+ * Return the first prime number larger than the integer
+ * given as a parameter. As before, 1 is returned for zero or
+ * negative input.
+ */
+int nextprime( int inval )
+{
+  static const unsigned char small_next[11] = { 1, 2, 3, 5, 5, 7, 7, 11, 11, 11, 11 };
+  unsigned c, r, i;
+
+  if (inval <= 0)
+    return 1;
+  if (inval <= 10)
+    return small_next[inval];
+
+  /* step to the first candidate above inval that is on the wheel */
+  c = (unsigned)inval + 1;
+  r = c % 210;
+  for (i = 0; wheel_res[i] < r; i++)
+    ;
+  c += wheel_res[i] - r;
+
+  while (!is_prime_wheeled(c)) {
+    c += wheel_gap[i];
+    i = (i == 47) ? 0 : i + 1;
+  }
+  return (int)c;
+}
+
+#ifdef DTEKV_BENCH
+#include "dtekv-lib.h"
+
+/* The original nextprime(): trial division by every integer up to n/2. */
+static int nextprime_ref( int inval )
+{
+  int perhapsprime, testfactor, found;
+
+  if (inval <= 0) return 1;
+  if (inval == 1) return 2;
+  if (inval == 2) return 3;
+  perhapsprime = ( inval + 1 ) | 1;
+  for (found = 0; ; perhapsprime += 2) {
+    for (testfactor = 3; testfactor <= (perhapsprime >> 1) + 1; testfactor += 1) {
+      found = 1;
+      if ((perhapsprime % testfactor) == 0) {
+        found = 0;
+        break;
+      }
+    }
+    if (found)
+      return perhapsprime;
+  }
+}
+
+#define SIEVE_LIMIT (1u << 17)
+static unsigned sieve_composite[SIEVE_LIMIT / 32];
+
+static int sieve_is_prime(unsigned n)
+{
+  return n >= 2 && !((sieve_composite[n >> 5] >> (n & 31)) & 1);
+}
+
+static void prime_report(const char *what, unsigned bad)
+{
+  print("prime_selftest: ");
+  print(what);
+  print(bad ? " FAILED, mismatches=" : " ok");
+  if (bad)
+    print_dec(bad);
+  print("\n");
+}
+
+/* function: prime_selftest
+   Description: Check is_prime_u32() and nextprime() against a sieve of
+   Eratosthenes below SIEVE_LIMIT (which crosses PRIME_MR_MIN, so both
+   code paths are covered), and against known hard 32-bit cases. */
+void prime_selftest(void)
+{
+  static const unsigned known[][2] = {
+    { 2047u, 0 }, { 1373653u, 0 }, { 25326001u, 0 }, { 3215031751u, 0 },
+    { 2147483649u, 0 }, { 4294967295u, 0 }, { 4294967291u, 1 },
+    { 2147483647u, 1 }, { 1234577u, 1 }, { 1234567u, 0 }
+  };
+  unsigned bad = 0, prev = 0;
+
+  for (unsigned i = 2; i * i < SIEVE_LIMIT; i++)
+    if (sieve_is_prime(i))
+      for (unsigned j = i * i; j < SIEVE_LIMIT; j += i)
+        sieve_composite[j >> 5] |= 1u << (j & 31);
+
+  for (unsigned n = 0; n < SIEVE_LIMIT; n++)
+    if (is_prime_u32(n) != sieve_is_prime(n))
+      bad++;
+  prime_report("is_prime_u32 vs sieve", bad);
+
+  bad = 0;
+  for (unsigned n = SIEVE_LIMIT - 1; n >= 3; n--) {
+    if (prev != 0 && (unsigned)nextprime((int)n) != prev)
+      bad++;
+    if (sieve_is_prime(n))
+      prev = n;
+  }
+  prime_report("nextprime vs sieve", bad);
+
+  bad = 0;
+  for (unsigned i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+    if (is_prime_u32(known[i][0]) != (int)known[i][1])
+      bad++;
+  prime_report("known 32-bit cases", bad);
+}
+
+static void prime_rate(const char *what, unsigned count, unsigned cycles)
+{
+  print("prime_bench: ");
+  print(what);
+  print(" cycles/prime=");
+  print_dec(cycles / count);
+  print(" primes/s=");
+  print_dec(CPU_CLK_HZ / (cycles / count));
+  print("\n");
+}
+
+/* function: prime_bench
+   Description: Primes per second from the lab seed 1234567, for the
+   original trial division and for the new engine. */
+void prime_bench(void)
+{
+  int p;
+  unsigned t0;
+
+  p = 1234567;
+  t0 = read_mcycle();
+  for (int i = 0; i < 4; i++)
+    p = nextprime_ref(p);
+  prime_rate("old", 4, read_mcycle() - t0);
+
+  p = 1234567;
+  t0 = read_mcycle();
+  for (int i = 0; i < 1024; i++)
+    p = nextprime(p);
+  prime_rate("new", 1024, read_mcycle() - t0);
+}
+#endif
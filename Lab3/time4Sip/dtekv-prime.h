@@ -0,0 +1,19 @@
+#ifndef DTEKV_PRIME_H
+#define DTEKV_PRIME_H
+
+/* Below this, is_prime_u32() trial-divides on the mod-210 wheel up to
+   sqrt(n); from here on it runs deterministic Miller-Rabin. */
+#ifndef PRIME_MR_MIN
+#define PRIME_MR_MIN 65536u
+#endif
+
+unsigned isqrt32(unsigned n);
+int is_prime_u32(unsigned n);
+int nextprime( int inval );
+
+#ifdef DTEKV_BENCH
+void prime_selftest(void);
+void prime_bench(void);
+#endif
+
+#endif
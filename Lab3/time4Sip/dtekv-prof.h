@@ -0,0 +1,86 @@
+#ifndef DTEKV_PROF_H
+#define DTEKV_PROF_H
+
+/* Region profiler on mcycle/minstret. Build with -DDTEKV_PROF (make prof)
+   to enable it; otherwise every macro below expands to nothing.
+
+     PROF_REGION(p_tick, "tick");          at file scope
+     PROF_BEGIN(p_tick); tick(&t); PROF_END(p_tick);
+     PROF_DUMP();                          table over the JTAG UART
+
+   Regions may nest, also across an interrupt: time spent in an inner
+   region (or in an ISR that is itself profiled) is included in the
+   outer region's total but not in its self time. Under dtekv-thread.h
+   every thread has its own open regions, and a region in which its
+   thread is preempted or blocks leaves out the time the others ran. */
+
+/* Deepest nesting of open regions, including ones opened in ISRs. */
+#ifndef PROF_MAX_DEPTH
+#define PROF_MAX_DEPTH 8
+#endif
+
+struct prof_region {
+  const char *name;
+  unsigned count;
+  unsigned min, max;          /* cycles, inclusive */
+  unsigned long long total;   /* cycles, inclusive */
+  unsigned long long self;    /* cycles, excluding nested regions */
+  unsigned long long insns;   /* retired instructions, inclusive */
+  struct prof_region *next;   /* list of regions seen by prof_dump() */
+  int listed;
+};
+
+/* Interrupt entry/exit cost, filled in by boot.S when built with
+   DTEKV_PROF: entry is from the first instruction of _irq_routine to
+   the call of the cause's irq_table handler (dtekv-irq.c, which falls
+   back to handle_interrupt for a cause nobody registered), exit from its
+   return to just before mret. The field order is shared with the offsets
+   in boot.S. */
+struct trap_stats {
+  unsigned count;
+  unsigned entry_total, entry_max;
+  unsigned exit_total, exit_max;
+};
+
+#ifdef DTEKV_PROF
+
+struct prof_frame {
+  struct prof_region *r;
+  unsigned c0, i0;            /* mcycle/minstret at PROF_BEGIN */
+  unsigned child;             /* cycles spent in nested regions */
+};
+
+/* The open regions of one thread, kept in its struct thread while
+   another one runs. */
+struct prof_stack {
+  struct prof_frame frame[PROF_MAX_DEPTH];
+  unsigned depth;             /* may exceed PROF_MAX_DEPTH; such frames are lost */
+  unsigned c_out, i_out;      /* mcycle/minstret when it was switched out */
+};
+
+extern struct trap_stats trap_stats;
+
+#define PROF_REGION(var, label) \
+  struct prof_region var = { label, 0, 0xffffffffu, 0, 0, 0, 0, 0, 0 }
+#define PROF_BEGIN(var)  prof_begin(&(var))
+#define PROF_END(var)    prof_end(&(var))
+#define PROF_DUMP()      prof_dump()
+#define PROF_RESET()     prof_reset()
+
+void prof_begin(struct prof_region *r);
+void prof_end(struct prof_region *r);
+void prof_dump(void);
+void prof_reset(void);
+void prof_switch(struct prof_stack *out, struct prof_stack *in);
+
+#else
+
+#define PROF_REGION(var, label)  extern struct prof_region var
+#define PROF_BEGIN(var)  ((void)0)
+#define PROF_END(var)    ((void)0)
+#define PROF_DUMP()      ((void)0)
+#define PROF_RESET()     ((void)0)
+
+#endif
+
+#endif
@@ -1,18 +1,23 @@
 /* labmain.c  — primes + timer interrupt updates to HEX display */
 
 #include <stdint.h>
+#include "dtekv-lib.h"
+#include "dtekv-irq.h"
+#include "dtekv-sieve.h"
+#include "dtekv-prof.h"
+#include "dtekv-timer.h"
+#include "dtekv-hex.h"
+#include "dtekv-bcd.h"
+#include "dtekv-boot.h"
+#include "dtekv-gpio.h"
+#include "dtekv-defer.h"
+#include "dtekv-prime.h"
+#include "dtekv-thread.h"
 
 /* ===== externs (provided) ===== */
-extern void print(const char*);
-extern void print_dec(unsigned int);
-extern void display_string(int, char*);
-extern void time2string(char*, int);
-extern void tick(int*);
-extern int nextprime(int);
+extern void display_string(char*);
 extern void enable_interrupt(void);
-extern void tick(int* t);
 extern int  mytime;
-extern volatile int timeoutcount;
 
 
 
@@ -23,136 +28,182 @@ extern volatile int timeoutcount;
 #define HEX_BASE     0x04000050u
 #define HEX_STRIDE   0x10u
 
-#define SW_BASE   0x04000010u
-#define SW_DATA   (*(volatile unsigned int*)(SW_BASE + 0x00))
-#define SW_DIR    (*(volatile unsigned int*)(SW_BASE + 0x04))
-#define SW_IMASK  (*(volatile unsigned int*)(SW_BASE + 0x08))
-#define SW_ECAP   (*(volatile unsigned int*)(SW_BASE + 0x0C))
-
-
-/* ===== TIMER (Intel Interval Timer) ===== */
-#define TIMER_BASE   0x04000020u
-#define TMR_STATUS   (*(volatile unsigned int*)(TIMER_BASE + 0x00))
-#define TMR_CONTROL  (*(volatile unsigned int*)(TIMER_BASE + 0x04))
-#define TMR_PERIODL  (*(volatile unsigned int*)(TIMER_BASE + 0x08))
-#define TMR_PERIODH  (*(volatile unsigned int*)(TIMER_BASE + 0x0C))
-#define CTRL_ITO     (1u << 0)
-#define CTRL_CONT    (1u << 1)
-#define CTRL_START   (1u << 2)
-#define ST_TO        (1u << 0)
-#define TIMER_CLK_HZ 30000000u        // dtekv interval timer clock (adjust if needed)
-#define IRQ_RATE_HZ  10u  
+#define SW3       3                 /* GPIO pin of the switch that steps the clock */
 
 /* ===== globals from template ===== */
-int  mytime       = 0x0000;                     /* MM:SS in BCD-like nibbles */
+int  mytime       = 0x0000;                     /* HH:MM:SS, packed BCD */
 char textstring[] = "text, more text, and even more text!";
-/* count timer interrupts; do work every 10th */
-volatile int timeoutcount = 0;
-volatile unsigned sw3_is_high = 0;   // 1 while SW3 is ON
+/* software timers: the clock at 1 Hz, the 16/17 status line at 10 Hz */
+static struct soft_timer clock_timer, status_timer;
 
 /* (b) add prime */
 int prime = 1234567;
 
-/* 7-segment digit patterns (active-low) for 0..9 */
-static const unsigned char LED_NBR[10] =
-  { 64,121,36,48,25,18,2,120,0,16 };
-
-/* one HEX digit → one display (HEX0..HEX5) */
-static inline void set_displays(int display_number, int value) {
-    if (display_number < 0 || display_number > 5) return;
-    volatile unsigned int *disp =
-        (volatile unsigned int *)(HEX_BASE + (unsigned)display_number * HEX_STRIDE);
-    unsigned int patt = (unsigned)LED_NBR[value & 0xF] | 0x80u;  /* DP off */
-    *disp = patt;
-}
-static inline void clear_display(int display_number){
-    if (display_number < 0 || display_number > 5) return;
-    volatile unsigned int *disp =
-        (volatile unsigned int *)(HEX_BASE + (unsigned)display_number * HEX_STRIDE);
-    *disp = 0xFFu; /* all segments off (active-low) */
-}
+/* ===== threads (dtekv-thread.h) =====
+   main prints the primes after 1234567; a second thread of the same
+   priority searches from SEARCH_START on its own. The 10 ms time slice
+   shares the CPU between the two; print_lock keeps their lines whole. */
+#define SLICE_US      10000u
+#define SEARCH_START  1000000001u
+#define SEARCH_REPORT 1000              /* primes per "Search:" line */
+
+static struct thread search_thread;
+static struct mutex print_lock;
+
+PROF_REGION(p_status, "status");
+PROF_REGION(p_status_print, "status print");
+PROF_REGION(p_tick, "tick");
+PROF_REGION(p_prime, "nextprime");
+
+static void clock_tick(struct soft_timer *t, void *arg);
+static void status_tick(struct soft_timer *t, void *arg);
 
 /* init timer for 1 Hz periodic interrupts @ 30 MHz clock */
 void labinit(void) {
-    /* --- Switch block: inputs + clear edges + enable IRQ for SW[3] --- */
-    SW_DIR   = 0x00000000u;        // inputs
-    SW_ECAP  = 0xFFFFFFFFu;        // clear any latched edges
-    SW_IMASK = (1u << 3);          // ONLY Switch #3 raises interrupts
-
-    /* --- Timer setup (unchanged) --- */
-    const uint32_t period = (TIMER_CLK_HZ / IRQ_RATE_HZ) - 1u;
-    TMR_CONTROL = 0;
-    TMR_STATUS  = 0;
-    TMR_PERIODL = (uint16_t)(period & 0xFFFFu);
-    TMR_PERIODH = (uint16_t)(period >> 16);
-    TMR_CONTROL = (CTRL_ITO | CTRL_CONT | CTRL_START);
+    /* --- Switch #3 only: debounced edges, read as events by main --- */
+    gpio_init(GPIO_BIT(SW3), 10);
+
+    /* --- priorities: switch edges first, the UART keeps draining
+       while the timer callbacks run --- */
+    irq_set_priority(IRQ_SWITCHES, 3);
+    irq_set_priority(JTAG_UART_IRQ, 2);
+    irq_set_priority(IRQ_TIMER, 1);
+
+    /* --- Timer service: one interrupt per deadline, both timers on
+       the same 100 ms grid so the clock shares every 10th one --- */
+    timer_init(TIMER_TICKLESS, 0);
+    thread_init(SLICE_US, 1);            /* main becomes a thread */
+    mutex_init(&print_lock);
+    unsigned long long t0 = timer_now();
+    timer_start_periodic(&status_timer, t0 + TIMER_MS(100),
+                         (unsigned)TIMER_MS(100), status_tick, 0);
+    timer_start_periodic(&clock_timer, t0 + TIMER_MS(1000),
+                         (unsigned)TIMER_MS(1000), clock_tick, 0);
+
+    /* --- UART output is queued and drained by its own interrupt --- */
+    uart_tx_init(UART_TX_BLOCK);
 
     /* --- finally enable global/external interrupts --- */
     enable_interrupt();
 }
+/* Called from both the clock timer and main; each call is one
+   hex_flush(), so neither can leave the other's update half done. */
 static inline void show_time_on_hex(void) {
     /* mytime format: [15:12]=M10, [11:8]=M1, [7:4]=S10, [3:0]=S1 */
-    int t   = mytime;
-    int m10 = (t >> 12) & 0xF;
-    int m1  = (t >> 8)  & 0xF;
-    int s10 = (t >> 4)  & 0xF;
-    int s1  =  t        & 0xF;
-
+    struct hex_frame f;
+    hex_frame_init(&f);
     /* HEX index 0 = rightmost digit on board */
-    set_displays(0, s1);
-    set_displays(1, s10);
-    set_displays(2, m1);
-    set_displays(3, m10);
-    clear_display(4);
-    clear_display(5);
+    hex_frame_nibbles(&f, 0, 4, (unsigned)mytime);
+    hex_frame_glyph(&f, 4, HEX_BLANK);
+    hex_frame_glyph(&f, 5, HEX_BLANK);
+    hex_flush(&f);
 }
 
 
 
 
-void handle_interrupt(unsigned cause) {
+static void clock_tick(struct soft_timer *t, void *arg) {
+    (void)t;
+    (void)arg;
+    PROF_BEGIN(p_tick);
+    mytime = (int)bcd_clock_inc((unsigned)mytime, &bcd_clock_100h);
+    PROF_END(p_tick);
+    show_time_on_hex();
+}
 
-    if (cause == 16u) {
-        if (TMR_STATUS & ST_TO) {
-            TMR_STATUS = 0;  // ack
-
-            // your 10→1 Hz divider for the clock (optional)
-            if (++timeoutcount >= 10) {
-                timeoutcount = 0;
-                tick(&mytime);
-                show_time_on_hex();
-            }
-
-            // print based on switch-held state
-            if (sw3_is_high) {
-                print_dec(17);
-            } else {
-                print_dec(16);
-            }
-            print("\n");
-        }
-    }
+/* Runs in main through defer_drain(), so the UART wait is never in an
+   interrupt handler. */
+static void status_print(unsigned value) {
+    PROF_BEGIN(p_status_print);
+    mutex_lock(&print_lock);
+    print_dec(value);
+    print("\n");
+    mutex_unlock(&print_lock);
+    PROF_END(p_status_print);
+}
+
+static void status_tick(struct soft_timer *t, void *arg) {
+    (void)t;
+    (void)arg;
+    PROF_BEGIN(p_status);
+    // sample the switch now, print it later
+    defer(status_print, (gpio_levels() & GPIO_BIT(SW3)) ? 17u : 16u);
+    PROF_END(p_status);
+}
 
+/* SW3 switched on: two seconds forward. clock_tick() updates mytime
+   from the timer interrupt, so the add is done with interrupts masked. */
+static void sw3_on(void) {
+    unsigned mie = irq_save();
+    mytime = (int)bcd_clock_add((unsigned)mytime, 2, &bcd_clock_100h);
+    irq_restore(mie);
+    show_time_on_hex();
+}
 
-    if (cause == 17u) {
-        unsigned edge = SW_ECAP;
-        if (edge & (1u << 3)) {
-            SW_ECAP = (1u << 3);                 // ack edge
-            sw3_is_high = (SW_DATA >> 3) & 1u;   // read current level
+/* The second prime search: odd numbers from SEARCH_START, one line per
+   SEARCH_REPORT primes found. Never blocks except for print_lock, so it
+   only gives up the CPU when its time slice ends. */
+static void search_task(unsigned arg) {
+    unsigned n = arg, found = 0;
 
-            if (sw3_is_high) { tick(&mytime); tick(&mytime); show_time_on_hex(); }
+    while (1) {
+        if (is_prime_u32(n) && ++found % SEARCH_REPORT == 0) {
+            mutex_lock(&print_lock);
+            print("Search: ");
+            print_dec(found);
+            print(" primes, last ");
+            print_dec(n);
+            print("\n");
+            mutex_unlock(&print_lock);
         }
+        n += 2;
     }
 }
 
+/* Timer and switches are dispatched through irq_table; nothing else is
+   enabled, so there is nothing left to do here. */
+void handle_interrupt(unsigned cause) {
+    (void)cause;
+}
+
 /* (c) new main: print primes forever */
 int main(void) {
+    boot_report();                     /* banner, boot cycles, memory map */
+#ifdef DTEKV_BENCH
+    irq_latency_bench();               /* needs the timer and UART to itself */
+#endif
     labinit();
-
+#ifdef DTEKV_BENCH
+    thread_bench();                    /* before main has a peer thread */
+#endif
+    thread_create(&search_thread, "search", search_task, SEARCH_START,
+                  4096, 1);
+
+#ifdef DTEKV_PROF
+    unsigned nprimes = 0;
+#endif
+    prime_stream_init(prime);
     while (1) {
+        struct gpio_event ev;
+        while (gpio_read_event(&ev))
+            if (ev.pin == SW3 && ev.level)
+                sw3_on();
+        defer_drain();                  /* status lines from the timer */
+
+        PROF_BEGIN(p_prime);
+        prime = prime_stream_next();
+        PROF_END(p_prime);
+        mutex_lock(&print_lock);
         print("Prime: ");
-        prime = nextprime(prime);
         print_dec((unsigned)prime);
         print("\n");
+#ifdef DTEKV_PROF
+        if (++nprimes == 1000) {        /* profile table every 1000 primes */
+            nprimes = 0;
+            PROF_DUMP();
+            thread_report();
+        }
+#endif
+        mutex_unlock(&print_lock);
     }
 }
\ No newline at end of file
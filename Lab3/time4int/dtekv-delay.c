@@ -0,0 +1,209 @@
+/* dtekv-delay.c
+   Busy and sleeping delays on the interval timer.
+
+   Without the timer service the counter is read through SNAPL/H and the
+   time is the sum of the distances it has counted down between reads,
+   taken modulo its period. That only needs one read per period, which a
+   polling loop easily makes, and it never touches the TO flag that a
+   polling lab like time4timer waits on. */
+
+#include "dtekv-delay.h"
+#include "dtekv-timer.h"
+#include "dtekv-lib.h"
+
+#ifndef TIMER_BASE
+#define TIMER_BASE 0x04000020u
+#endif
+#define TMR_REG(off)  (*(volatile unsigned *)(TIMER_BASE + (off)))
+#define TMR_STATUS    TMR_REG(0x00)
+#define TMR_CONTROL   TMR_REG(0x04)
+#define TMR_PERIODL   TMR_REG(0x08)
+#define TMR_PERIODH   TMR_REG(0x0C)
+#define TMR_SNAPL     TMR_REG(0x10)
+#define TMR_SNAPH     TMR_REG(0x14)
+#define ST_RUN        (1u << 1)
+#define CTRL_CONT     (1u << 1)
+#define CTRL_START    (1u << 2)
+
+/* timer cycles per microsecond, Q16.16, folded at compile time */
+#define DL_TICKS_PER_US_Q16 \
+  ((unsigned)(((unsigned long long)TIMER_CLK_HZ << 16) / 1000000u))
+
+/* iterations per millisecond of the inner loop of delay() */
+#define DL_OLD_LOOPS 4771
+#define DL_OLD_MS    10
+
+extern void delay(int ms);           /* timetemplate.S */
+
+static unsigned dl_period;           /* period register value */
+static unsigned dl_last;             /* last snapshot */
+static unsigned long long dl_time;   /* cycles counted so far */
+
+static unsigned dl_cpu_khz;          /* mcycle per timer millisecond */
+static unsigned dl_old_ticks;        /* timer cycles taken by delay(DL_OLD_MS) */
+static unsigned dl_new_ticks;        /* and by delay_ms(DL_OLD_MS) */
+
+static unsigned dl_snap(void)
+{
+  TMR_SNAPL = 0;
+  return (TMR_SNAPL & 0xffffu) | (TMR_SNAPH << 16);
+}
+
+/* Monotonic timer cycles. The first call after a pause longer than a
+   period counts it short, so a delay takes its reference from a fresh
+   call rather than from an old one. */
+static unsigned long long dl_now(void)
+{
+  unsigned mie, snap, d;
+  unsigned long long now;
+
+  if (timer_active())
+    return timer_now();
+  mie = irq_save();
+  snap = dl_snap();
+  d = dl_last - snap;
+  if (snap > dl_last)                  /* reloaded since the last read */
+    d += dl_period + 1;
+  dl_last = snap;
+  dl_time += d;
+  now = dl_time;
+  irq_restore(mie);
+  return now;
+}
+
+static void dl_wait(unsigned long long ticks)
+{
+  unsigned long long end;
+
+  if (!timer_active())                 /* the lab may have reprogrammed it */
+    dl_period = (TMR_PERIODL & 0xffffu) | (TMR_PERIODH << 16);
+  end = dl_now() + ticks;
+  while (dl_now() < end)
+    ;
+}
+
+static unsigned long long dl_us_ticks(unsigned us)
+{
+  return ((unsigned long long)us * DL_TICKS_PER_US_Q16) >> 16;
+}
+
+void delay_us(unsigned us)
+{
+  dl_wait(dl_us_ticks(us));
+}
+
+void delay_ms(unsigned ms)
+{
+  dl_wait(TIMER_MS(ms));
+}
+
+static void dl_wake(struct soft_timer *t, void *arg)
+{
+  (void)t;
+  *(volatile int *)arg = 1;
+}
+
+/* Sleep until a one-shot timer fires. wfi runs with MIE clear so that
+   the wake-up cannot slip in between the test and the wfi; a pending
+   interrupt still ends the wfi and is taken at irq_restore(). */
+static void dl_sleep(unsigned long long ticks)
+{
+  struct soft_timer t;
+  volatile int done = 0;
+  unsigned mie;
+
+  mie = irq_save();
+  if (!mie || !timer_active()) {
+    irq_restore(mie);
+    dl_wait(ticks);
+    return;
+  }
+  t.pprev = 0;
+  timer_start(&t, timer_now() + ticks, dl_wake, (void *)&done);
+  while (!done) {
+    asm volatile ("wfi");
+    irq_restore(mie);
+    mie = irq_save();
+  }
+  irq_restore(mie);
+}
+
+void delay_sleep_us(unsigned us)
+{
+  dl_sleep(dl_us_ticks(us));
+}
+
+void delay_sleep_ms(unsigned ms)
+{
+  dl_sleep(TIMER_MS(ms));
+}
+
+void delay_init(void)
+{
+  unsigned long long t0;
+  unsigned c0, c1, dt;
+
+  if (!timer_active()) {
+    if (!(TMR_STATUS & ST_RUN)) {      /* free running, no interrupts */
+      TMR_PERIODL = 0xffffu;
+      TMR_PERIODH = 0xffffu;
+      TMR_CONTROL = CTRL_CONT | CTRL_START;
+    }
+    dl_period = (TMR_PERIODL & 0xffffu) | (TMR_PERIODH << 16);
+    dl_last = dl_snap();
+  }
+
+  /* CPU clock: mcycle over one timer millisecond */
+  t0 = dl_now();
+  c0 = read_mcycle();
+  while ((dt = (unsigned)(dl_now() - t0)) < TIMER_MS(1))
+    ;
+  c1 = read_mcycle();
+  dl_cpu_khz = (c1 - c0) * (TIMER_CLK_HZ / 1000u) / dt;
+
+  /* the old loop and the new delay over the same nominal time */
+  t0 = dl_now();
+  delay(DL_OLD_MS);
+  dl_old_ticks = (unsigned)(dl_now() - t0);
+  t0 = dl_now();
+  delay_ms(DL_OLD_MS);
+  dl_new_ticks = (unsigned)(dl_now() - t0);
+}
+
+/* ticks as microseconds, then the deviation from nominal in 0.1 % */
+static void dl_print_run(const char *what, unsigned ticks)
+{
+  unsigned us = ticks / (TIMER_CLK_HZ / 1000000u);
+  unsigned nominal = DL_OLD_MS * 1000u;
+  unsigned dev = us >= nominal ? us - nominal : nominal - us;
+
+  dev = (dev * 1000u + nominal / 2) / nominal;
+  print(what);
+  print_dec(us);
+  print(" us (");
+  printc(us >= nominal ? '+' : '-');
+  print_dec(dev / 10);
+  printc('.');
+  print_dec(dev % 10);
+  print("%)\n");
+}
+
+/* function: delay_report
+   Description: the measured CPU clock, how far delay(10) and
+   delay_ms(10) are from 10 ms, and the inner-loop count that would have
+   made delay() right on this build. */
+void delay_report(void)
+{
+  print("delay: timer ");
+  print_dec(TIMER_CLK_HZ / 1000u);
+  print(" kHz, cpu ");
+  print_dec(dl_cpu_khz);
+  print(" kHz\n");
+  dl_print_run("delay: old delay(10) ", dl_old_ticks);
+  dl_print_run("delay: delay_ms(10)  ", dl_new_ticks);
+  print("delay: old loop needs ");
+  print_dec(dl_old_ticks ? DL_OLD_LOOPS * (unsigned)TIMER_MS(DL_OLD_MS) / dl_old_ticks : 0);
+  print(" iterations per ms, not ");
+  print_dec(DL_OLD_LOOPS);
+  printc('\n');
+}
@@ -0,0 +1,32 @@
+#ifndef DTEKV_DELAY_H
+#define DTEKV_DELAY_H
+
+/* Delays timed by the interval timer rather than by counted loops, so
+   they hold for any CPU clock and -O level:
+
+     delay_init();            once, after the lab has set up the timer
+     delay_ms(1000);          busy wait
+     delay_sleep_ms(1000);    wfi until a one-shot software timer fires
+
+   With the timer service running (dtekv-timer.h) the time comes from
+   timer_now(). Otherwise the timer is read directly through its snapshot
+   registers at whatever period the lab programmed; if it is stopped,
+   delay_init() starts it free running, without interrupts. */
+
+/* Start the timer if needed, then measure the CPU clock and the old
+   delay() loop of timetemplate.S against TIMER_CLK_HZ. */
+void delay_init(void);
+
+void delay_us(unsigned us);
+void delay_ms(unsigned ms);
+
+/* As delay_us/delay_ms, but sleep in wfi until a one-shot timer wakes
+   the hart. Needs the timer service and interrupts enabled; falls back
+   to the busy wait otherwise. Not for use inside an interrupt handler. */
+void delay_sleep_us(unsigned us);
+void delay_sleep_ms(unsigned ms);
+
+/* Print what delay_init() measured. */
+void delay_report(void);
+
+#endif
@@ -0,0 +1,761 @@
+/* dtekv-fix.c
+   Q16.16 division, roots, CORDIC, exp/log and float conversions. The
+   transcendental functions work internally in Q2.30 (values) and Q3.29
+   (angles) so that the last Q16.16 bit comes out rounded rather than
+   truncated through a chain of steps. */
+
+#include "dtekv-fix.h"
+#include "dtekv-lib.h"
+
+#define FIX_LN2_Q32    2977044472u       /* ln 2 * 2^32 */
+#define FIX_2PI_Q32    26986075409ll     /* 2 pi * 2^32 */
+#define FIX_INV_LN2    94548             /* 1 / ln 2 in Q16.16 */
+#define FIX_INV_2PI    683565276         /* 1 / (2 pi) * 2^32 */
+#define FIX_PI_Q29     1686629713        /* pi * 2^29 */
+#define FIX_PI_2_Q29   843314857         /* pi / 2 * 2^29 */
+#define FIX_EXP_MAX    681391            /* largest x with e^x <= FIX16_MAX */
+#define FIX_EXP_MIN    (-772244)         /* e^x rounds to 0 below this */
+
+#define CORDIC_ITERS   24
+#define CORDIC_K       652032874         /* prod 1/sqrt(1 + 2^-2i) in Q2.30 */
+
+/* atan(2^-i) in Q3.29 */
+static const int cordic_atan[CORDIC_ITERS] = {
+  421657428, 248918915, 131521918, 66762579, 33510843, 16771758,
+  8387925, 4194219, 2097141, 1048575, 524288, 262144, 131072, 65536,
+  32768, 16384, 8192, 4096, 2048, 1024, 512, 256, 128, 64
+};
+
+/* 1 / i! in Q2.30 for the exp polynomial, i = 0 .. 8 */
+static const int exp_coef[9] = {
+  1073741824, 1073741824, 536870912, 178956971, 44739243, 8947849,
+  1491308, 213044, 26631
+};
+
+/* Leading zeros of x != 0. */
+static unsigned clz32(unsigned x)
+{
+  unsigned n = 0;
+
+  if (!(x & 0xffff0000u)) { n += 16; x <<= 16; }
+  if (!(x & 0xff000000u)) { n += 8; x <<= 8; }
+  if (!(x & 0xf0000000u)) { n += 4; x <<= 4; }
+  if (!(x & 0xc0000000u)) { n += 2; x <<= 2; }
+  if (!(x & 0x80000000u)) n += 1;
+  return n;
+}
+
+/* x >> s (1 <= s <= 63) rounded to nearest, ties to even. */
+static unsigned long long rne_shift(unsigned long long x, unsigned s)
+{
+  unsigned long long q = x >> s, rem = x & ((1ull << s) - 1);
+  unsigned long long half = 1ull << (s - 1);
+
+  if (rem > half || (rem == half && (q & 1)))
+    q++;
+  return q;
+}
+
+/* Magnitude q with sign neg to Q16.16, saturating; q may be 2^31 for
+   FIX16_MIN. */
+static fix16_t fix_signed(unsigned long long q, int neg)
+{
+  if (neg)
+    return q >= 0x80000000ull ? FIX16_MIN : -(fix16_t)q;
+  return q > 0x7fffffffull ? FIX16_MAX : (fix16_t)q;
+}
+
+/* function: fix16_div
+   Description: The integer part with one divu, then the 16 fraction
+   bits with a second divu when b fits in 16 bits (the remainder shifted
+   up still fits in 32), else one bit at a time. Rounds halves away from
+   zero. */
+fix16_t fix16_div(fix16_t a, fix16_t b)
+{
+  unsigned ua = a < 0 ? 0u - (unsigned)a : (unsigned)a;
+  unsigned ub = b < 0 ? 0u - (unsigned)b : (unsigned)b;
+  int neg = (a ^ b) < 0;
+  unsigned q, r;
+
+  if (ub == 0)
+    return a < 0 ? FIX16_MIN : FIX16_MAX;
+  q = ua / ub;
+  r = ua % ub;
+  if (q > 0x8000u)
+    return neg ? FIX16_MIN : FIX16_MAX;
+  q <<= 16;
+  if (ub <= 0xffffu) {
+    r <<= 16;
+    q |= r / ub;
+    r %= ub;
+  } else {
+    for (unsigned bit = 0x8000u; bit; bit >>= 1) {
+      r <<= 1;                /* r < ub <= 2^31 */
+      if (r >= ub) {
+        r -= ub;
+        q |= bit;
+      }
+    }
+  }
+  if (r >= ub - r)
+    q++;
+  return fix_signed(q, neg);
+}
+
+/* function: fix16_recip
+   Description: 2^32 / |a| from (2^32 - 1) / |a| and its remainder. */
+fix16_t fix16_recip(fix16_t a)
+{
+  unsigned ua = a < 0 ? 0u - (unsigned)a : (unsigned)a;
+  unsigned q, r;
+
+  if (ua < 2)
+    return a < 0 ? FIX16_MIN : FIX16_MAX;
+  q = 0xffffffffu / ua;
+  r = 0xffffffffu - q * ua + 1;
+  if (r == ua) {
+    q++;
+    r = 0;
+  }
+  if (r >= ua - r)
+    q++;
+  return fix_signed(q, a < 0);
+}
+
+/* function: fix16_sqrt
+   Description: Digit-by-digit root of a * 2^16, two result bits per
+   step. The integer half of the root comes from a itself; then the
+   remainder and root move up 16 bits (with the half-bit folded in when
+   the remainder would overflow) for the fraction half, and the last
+   comparison rounds. */
+fix16_t fix16_sqrt(fix16_t a)
+{
+  unsigned num, res = 0, bit;
+
+  if (a <= 0)
+    return 0;
+  num = (unsigned)a;
+  bit = (num & 0xfff00000u) ? 1u << 30 : 1u << 18;
+  while (bit > num)
+    bit >>= 2;
+  for (int half = 0; half < 2; half++) {
+    for (; bit; bit >>= 2) {
+      if (num >= res + bit) {
+        num -= res + bit;
+        res = (res >> 1) + bit;
+      } else {
+        res >>= 1;
+      }
+    }
+    if (half == 0) {
+      if (num > 0xffffu) {
+        num -= res;
+        num = (num << 16) - 0x8000u;
+        res = (res << 16) + 0x8000u;
+      } else {
+        num <<= 16;
+        res <<= 16;
+      }
+      bit = 1u << 14;
+    }
+  }
+  if (num > res)
+    res++;
+  return (fix16_t)res;
+}
+
+/* function: fix16_sincos
+   Description: The angle is reduced to -pi .. pi in Q.32 (so large
+   angles lose nothing to an inexact 2 pi), folded into -pi/2 .. pi/2,
+   and rotated from (K, 0) in CORDIC_ITERS shift-and-add steps. */
+void fix16_sincos(fix16_t angle, fix16_t *s, fix16_t *c)
+{
+  long long k = ((long long)angle * FIX_INV_2PI + (1ll << 47)) >> 48;
+  int z = (int)((((long long)angle << 16) - k * FIX_2PI_Q32) >> 3);
+  int x = CORDIC_K, y = 0, flip = 0;
+
+  if (z > FIX_PI_2_Q29) {
+    z = FIX_PI_Q29 - z;
+    flip = 1;
+  } else if (z < -FIX_PI_2_Q29) {
+    z = -FIX_PI_Q29 - z;
+    flip = 1;
+  }
+  for (int i = 0; i < CORDIC_ITERS; i++) {
+    int dx = y >> i, dy = x >> i;
+
+    if (z >= 0) {
+      x -= dx;
+      y += dy;
+      z -= cordic_atan[i];
+    } else {
+      x += dx;
+      y -= dy;
+      z += cordic_atan[i];
+    }
+  }
+  x = (x + (1 << 13)) >> 14;
+  *s = (y + (1 << 13)) >> 14;
+  *c = flip ? -x : x;
+}
+
+fix16_t fix16_sin(fix16_t angle)
+{
+  fix16_t s, c;
+
+  fix16_sincos(angle, &s, &c);
+  return s;
+}
+
+fix16_t fix16_cos(fix16_t angle)
+{
+  fix16_t s, c;
+
+  fix16_sincos(angle, &s, &c);
+  return c;
+}
+
+/* function: fix16_atan2
+   Description: (x, y) is scaled so its larger coordinate has its top bit
+   at 28, which leaves room for the CORDIC gain and keeps small inputs
+   from losing angle resolution, turned into the right half-plane, and
+   rotated onto the x axis while the angle turned through is summed. */
+fix16_t fix16_atan2(fix16_t y, fix16_t x)
+{
+  unsigned ux = x < 0 ? 0u - (unsigned)x : (unsigned)x;
+  unsigned uy = y < 0 ? 0u - (unsigned)y : (unsigned)y;
+  int sh, z = 0;
+
+  if ((ux | uy) == 0)
+    return 0;
+  sh = (int)clz32(ux | uy) - 3;
+  if (sh >= 0) {
+    x = (int)((unsigned)x << sh);
+    y = (int)((unsigned)y << sh);
+  } else {
+    x >>= -sh;
+    y >>= -sh;
+  }
+  if (x < 0) {
+    z = y >= 0 ? FIX_PI_Q29 : -FIX_PI_Q29;
+    x = -x;
+    y = -y;
+  }
+  for (int i = 0; i < CORDIC_ITERS; i++) {
+    int dx = y >> i, dy = x >> i;
+
+    if (y < 0) {
+      x -= dx;
+      y += dy;
+      z -= cordic_atan[i];
+    } else {
+      x += dx;
+      y -= dy;
+      z += cordic_atan[i];
+    }
+  }
+  return (z + (1 << 12)) >> 13;
+}
+
+/* function: fix16_exp
+   Description: x = k ln 2 + r with |r| <= ln 2 / 2 (r kept in Q.32),
+   e^r from its Taylor polynomial by Horner in Q2.30, then shifted by k. */
+fix16_t fix16_exp(fix16_t x)
+{
+  long long k, p;
+  int r, sh;
+
+  if (x > FIX_EXP_MAX)
+    return FIX16_MAX;
+  if (x < FIX_EXP_MIN)
+    return 0;
+  k = ((long long)x * FIX_INV_LN2 + (1ll << 31)) >> 32;
+  r = (int)((((long long)x << 16) - k * FIX_LN2_Q32) >> 2);
+  p = exp_coef[8];
+  for (int i = 7; i >= 0; i--)
+    p = exp_coef[i] + ((p * r + (1 << 29)) >> 30);
+  sh = (int)k - 14;
+  if (sh >= 0)
+    return fix16_sat(p << sh);
+  if (sh < -62)
+    return 0;
+  return (fix16_t)rne_shift((unsigned long long)p, (unsigned)-sh);
+}
+
+/* log2(a) for a > 0 in Q12.20: the position of the top bit gives the
+   integer part; the mantissa m in [1, 2) is squared twenty times, and
+   each square that reaches 2 is one fraction bit (log2 m^2 = 2 log2 m). */
+static int fix_log2_q20(fix16_t a)
+{
+  unsigned n = clz32((unsigned)a);
+  unsigned m = (unsigned)a << (n - 1);   /* Q2.30, 1 <= m < 2 */
+  int l = (15 - (int)n) * (1 << 20);
+
+  for (int bit = 1 << 19; bit; bit >>= 1) {
+    m = (unsigned)(((unsigned long long)m * m + (1u << 29)) >> 30);
+    if (m >= 0x80000000u) {
+      m >>= 1;
+      l += bit;
+    }
+  }
+  return l;
+}
+
+fix16_t fix16_log2(fix16_t a)
+{
+  if (a <= 0)
+    return FIX16_MIN;
+  return (fix_log2_q20(a) + 8) >> 4;
+}
+
+fix16_t fix16_log(fix16_t a)
+{
+  if (a <= 0)
+    return FIX16_MIN;
+  return (fix16_t)(((long long)fix_log2_q20(a) * FIX_LN2_Q32 + (1ll << 35)) >> 36);
+}
+
+union fix_f32 {
+  float f;
+  unsigned u;
+};
+
+union fix_f64 {
+  double d;
+  unsigned long long u;
+};
+
+/* function: fix16_from_float
+   Description: value * 2^16 = mantissa * 2^(exponent - 134). */
+fix16_t fix16_from_float(float f)
+{
+  union fix_f32 v = { f };
+  int e = (int)((v.u >> 23) & 0xff), sh = e - 134;
+  unsigned m = (v.u & 0x7fffffu) | 0x800000u;
+  unsigned long long q;
+
+  if (e == 0xff && (v.u & 0x7fffffu))
+    return 0;
+  if (sh >= 8)
+    q = 0x80000000ull;
+  else if (sh >= 0)
+    q = (unsigned long long)m << sh;
+  else if (sh < -25 || e == 0)
+    q = 0;
+  else
+    q = rne_shift(m, (unsigned)-sh);
+  return fix_signed(q, (int)(v.u >> 31));
+}
+
+/* function: fix16_to_float
+   Description: The top set bit gives the exponent; more than 24
+   significant bits round to nearest even, which may carry into the
+   exponent. */
+float fix16_to_float(fix16_t a)
+{
+  union fix_f32 v;
+  unsigned ua = a < 0 ? 0u - (unsigned)a : (unsigned)a;
+  unsigned top, m;
+
+  if (ua == 0)
+    return 0.0f;
+  top = 31 - clz32(ua);
+  if (top > 23) {
+    m = (unsigned)rne_shift(ua, top - 23);
+    if (m >> 24) {
+      m >>= 1;
+      top++;
+    }
+  } else {
+    m = ua << (23 - top);
+  }
+  v.u = (a < 0 ? 0x80000000u : 0) | ((top + 111) << 23) | (m & 0x7fffffu);
+  return v.f;
+}
+
+/* function: fix16_from_double
+   Description: value * 2^16 = mantissa * 2^(exponent - 1059). */
+fix16_t fix16_from_double(double d)
+{
+  union fix_f64 v = { d };
+  int e = (int)((v.u >> 52) & 0x7ff), sh = e - 1059;
+  unsigned long long m = (v.u & 0xfffffffffffffull) | (1ull << 52), q;
+
+  if (e == 0x7ff && (v.u & 0xfffffffffffffull))
+    return 0;
+  if (sh > -22)
+    q = 0x80000000ull;
+  else if (sh < -54 || e == 0)
+    q = 0;
+  else
+    q = rne_shift(m, (unsigned)-sh);
+  return fix_signed(q, (int)(v.u >> 63));
+}
+
+/* function: fix16_to_double
+   Description: Exact; 31 bits fit the 53-bit mantissa. */
+double fix16_to_double(fix16_t a)
+{
+  union fix_f64 v;
+  unsigned ua = a < 0 ? 0u - (unsigned)a : (unsigned)a;
+  unsigned top;
+
+  if (ua == 0)
+    return 0.0;
+  top = 31 - clz32(ua);
+  v.u = ((unsigned long long)(a < 0) << 63)
+      | ((unsigned long long)(top + 1007) << 52)
+      | (((unsigned long long)ua << (52 - top)) & 0xfffffffffffffull);
+  return v.d;
+}
+
+#ifdef DTEKV_BENCH
+#include "dtekv-fmt.h"
+
+/* Inputs per operation. */
+#define FIX_BENCH_N  32
+
+#define FB_PI   3.14159265358979323846
+#define FB_LN2  0.69314718055994530942
+
+/* The softfloat side of fix_bench(): each operation the way float code
+   for this core would do it, every float operation a softfloat.a call.
+   Polynomials are as short as float precision allows. */
+
+static float fb_f_scale(float x, int k)         /* x * 2^k, no overflow */
+{
+  union fix_f32 v = { x };
+
+  v.u += (unsigned)k << 23;
+  return v.f;
+}
+
+static float fb_f_sin(float x, float unused)
+{
+  int n = (int)(x * (float)(0.5 / FB_PI) + (x >= 0 ? 0.5f : -0.5f));
+  float x2;
+
+  x -= (float)n * (float)(2 * FB_PI);
+  if (x > (float)(FB_PI / 2))
+    x = (float)FB_PI - x;
+  else if (x < (float)(-FB_PI / 2))
+    x = (float)-FB_PI - x;
+  x2 = x * x;
+  return x * (1 + x2 * (-1.0f / 6 + x2 * (1.0f / 120 + x2 * (-1.0f / 5040
+         + x2 * (1.0f / 362880 + x2 * (-1.0f / 39916800))))));
+}
+
+static float fb_f_cos(float x, float unused)
+{
+  return fb_f_sin(x + (float)(FB_PI / 2), 0);
+}
+
+static float fb_f_sqrt(float a, float unused)
+{
+  union fix_f32 v = { a };
+
+  if (a <= 0)
+    return 0;
+  v.u = (v.u >> 1) + 0x1fc00000u;
+  for (int i = 0; i < 3; i++)
+    v.f = 0.5f * (v.f + a / v.f);
+  return v.f;
+}
+
+static float fb_f_atan(float t)                 /* 0 <= t <= 1 */
+{
+  float off = 0, t2;
+
+  if (t > 0.41421356f) {
+    t = (t - 1) / (t + 1);
+    off = (float)(FB_PI / 4);
+  }
+  t2 = t * t;
+  return off + t * (1 + t2 * (-1.0f / 3 + t2 * (1.0f / 5 + t2 * (-1.0f / 7
+         + t2 * (1.0f / 9 + t2 * (-1.0f / 11 + t2 * (1.0f / 13)))))));
+}
+
+static float fb_f_atan2(float y, float x)
+{
+  float ax = x < 0 ? -x : x, ay = y < 0 ? -y : y, a;
+
+  if (ax == 0 && ay == 0)
+    return 0;
+  if (ay <= ax)
+    a = fb_f_atan(ay / ax);
+  else
+    a = (float)(FB_PI / 2) - fb_f_atan(ax / ay);
+  if (x < 0)
+    a = (float)FB_PI - a;
+  return y < 0 ? -a : a;
+}
+
+static float fb_f_exp(float x, float unused)
+{
+  int k = (int)(x * (float)(1 / FB_LN2) + (x >= 0 ? 0.5f : -0.5f));
+  float r = x - (float)k * (float)FB_LN2;
+
+  return fb_f_scale(1 + r * (1 + r * (1.0f / 2 + r * (1.0f / 6 + r * (1.0f / 24
+         + r * (1.0f / 120 + r * (1.0f / 720 + r * (1.0f / 5040))))))), k);
+}
+
+static float fb_f_log(float a, float unused)
+{
+  union fix_f32 v = { a };
+  int e = (int)(v.u >> 23) - 127;
+  float s, s2;
+
+  v.u = (v.u & 0x7fffffu) | 0x3f800000u;        /* 1 <= m < 2 */
+  if (v.f > 1.41421356f) {
+    v.f *= 0.5f;
+    e++;
+  }
+  s = (v.f - 1) / (v.f + 1);
+  s2 = s * s;
+  return (float)e * (float)FB_LN2 + 2 * s * (1 + s2 * (1.0f / 3
+         + s2 * (1.0f / 5 + s2 * (1.0f / 7 + s2 * (1.0f / 9)))));
+}
+
+static float fb_f_add(float a, float b) { return a + b; }
+static float fb_f_mul(float a, float b) { return a * b; }
+static float fb_f_div(float a, float b) { return a / b; }
+static float fb_f_recip(float a, float b) { return 1 / a; }
+
+/* The references, in double with series long enough to be exact far
+   below one Q16.16 LSB over the bench ranges. */
+
+static double fb_d_sin(double x, double unused)
+{
+  double t, s;
+
+  x -= (double)(int)(x / (2 * FB_PI)) * (2 * FB_PI);
+  t = s = x;
+  for (int i = 1; i < 30; i++) {
+    t = -t * x * x / ((2 * i) * (2 * i + 1));
+    s += t;
+  }
+  return s;
+}
+
+static double fb_d_cos(double x, double unused)
+{
+  return fb_d_sin(x + FB_PI / 2, 0);
+}
+
+static double fb_d_sqrt(double a, double unused)
+{
+  double x = a > 1 ? a : 1;
+
+  if (a <= 0)
+    return 0;
+  for (int i = 0; i < 40; i++)
+    x = 0.5 * (x + a / x);
+  return x;
+}
+
+static double fb_d_atan(double t)               /* 0 <= t <= 1 */
+{
+  double off = 0, p, s = 0;
+
+  if (t > 0.41421356) {
+    t = (t - 1) / (t + 1);
+    off = FB_PI / 4;
+  }
+  p = t;
+  for (int i = 0; i < 40; i++) {
+    s += (i & 1 ? -p : p) / (2 * i + 1);
+    p *= t * t;
+  }
+  return off + s;
+}
+
+static double fb_d_atan2(double y, double x)
+{
+  double ax = x < 0 ? -x : x, ay = y < 0 ? -y : y, a;
+
+  if (ax == 0 && ay == 0)
+    return 0;
+  if (ay <= ax)
+    a = fb_d_atan(ay / ax);
+  else
+    a = FB_PI / 2 - fb_d_atan(ax / ay);
+  if (x < 0)
+    a = FB_PI - a;
+  return y < 0 ? -a : a;
+}
+
+static double fb_d_exp(double x, double unused)
+{
+  int k = (int)(x / FB_LN2 + (x >= 0 ? 0.5 : -0.5));
+  double r = x - k * FB_LN2, t = 1, s = 1;
+
+  for (int i = 1; i < 25; i++) {
+    t *= r / i;
+    s += t;
+  }
+  for (; k > 0; k--)
+    s *= 2;
+  for (; k < 0; k++)
+    s *= 0.5;
+  return s;
+}
+
+static double fb_d_log(double a, double unused)
+{
+  double s, p, sum = 0;
+  int e = 0;
+
+  while (a >= 1.41421356) {
+    a *= 0.5;
+    e++;
+  }
+  while (a < 0.70710678) {
+    a *= 2;
+    e--;
+  }
+  s = (a - 1) / (a + 1);
+  p = s;
+  for (int i = 0; i < 30; i++) {
+    sum += p / (2 * i + 1);
+    p *= s * s;
+  }
+  return e * FB_LN2 + 2 * sum;
+}
+
+static double fb_d_add(double a, double b) { return a + b; }
+static double fb_d_mul(double a, double b) { return a * b; }
+static double fb_d_div(double a, double b) { return a / b; }
+static double fb_d_recip(double a, double b) { return 1 / a; }
+
+static fix16_t fb_add(fix16_t a, fix16_t b) { return fix16_add(a, b); }
+static fix16_t fb_mul(fix16_t a, fix16_t b) { return fix16_mul(a, b); }
+static fix16_t fb_div(fix16_t a, fix16_t b) { return fix16_div(a, b); }
+static fix16_t fb_recip(fix16_t a, fix16_t b) { return fix16_recip(a); }
+static fix16_t fb_sqrt(fix16_t a, fix16_t b) { return fix16_sqrt(a); }
+static fix16_t fb_sin(fix16_t a, fix16_t b) { return fix16_sin(a); }
+static fix16_t fb_cos(fix16_t a, fix16_t b) { return fix16_cos(a); }
+static fix16_t fb_atan2(fix16_t a, fix16_t b) { return fix16_atan2(a, b); }
+static fix16_t fb_exp(fix16_t a, fix16_t b) { return fix16_exp(a); }
+static fix16_t fb_log(fix16_t a, fix16_t b) { return fix16_log(a); }
+
+/* Both arguments are drawn from lo .. hi. */
+struct fix_bench_op {
+  const char *name;
+  fix16_t (*fix)(fix16_t, fix16_t);
+  float (*flt)(float, float);
+  double (*ref)(double, double);
+  fix16_t lo, hi;
+};
+
+static const struct fix_bench_op fix_bench_ops[] = {
+  { "add  ", fb_add, fb_f_add, fb_d_add, FIX16(-1000), FIX16(1000) },
+  { "mul  ", fb_mul, fb_f_mul, fb_d_mul, FIX16(-100), FIX16(100) },
+  { "div  ", fb_div, fb_f_div, fb_d_div, FIX16(0.5), FIX16(100) },
+  { "recip", fb_recip, fb_f_recip, fb_d_recip, FIX16(0.01), FIX16(100) },
+  { "sqrt ", fb_sqrt, fb_f_sqrt, fb_d_sqrt, 0, FIX16(30000) },
+  { "sin  ", fb_sin, fb_f_sin, fb_d_sin, FIX16(-10), FIX16(10) },
+  { "cos  ", fb_cos, fb_f_cos, fb_d_cos, FIX16(-10), FIX16(10) },
+  { "atan2", fb_atan2, fb_f_atan2, fb_d_atan2, FIX16(-100), FIX16(100) },
+  { "exp  ", fb_exp, fb_f_exp, fb_d_exp, FIX16(-10), FIX16(10) },
+  { "log  ", fb_log, fb_f_log, fb_d_log, FIX16(0.001), FIX16(30000) },
+};
+
+/* Error in tenths of a Q16.16 LSB. */
+static unsigned fb_err(double got, double want)
+{
+  double e = (got - want) * 65536.0;
+
+  return (unsigned)((e < 0 ? -e : e) * 10.0 + 0.5);
+}
+
+static void fb_tenths(unsigned x, unsigned width)
+{
+  print_col(x / 10, width);
+  printc('.');
+  printc((char)('0' + x % 10));
+}
+
+/* function: fix_bench
+   Description: For every operation, average cycles per call of the
+   fixed-point function and of its float equivalent over FIX_BENCH_N
+   inputs, and the worst error of each against the double reference in
+   Q16.16 LSB. Both sides get the same inputs, the fix16 values; float
+   holds them exactly only below 256, and that rounding is part of its
+   error. Then the cost of the conversions both ways. */
+void fix_bench(void)
+{
+  static fix16_t a[FIX_BENCH_N], b[FIX_BENCH_N], r[FIX_BENCH_N];
+  static float fa[FIX_BENCH_N], fb[FIX_BENCH_N], fr[FIX_BENCH_N];
+  unsigned seed = 12345u, t0, t_fix, t_flt;
+
+  print("fix_bench: op     cycles fix  float    err LSB fix  float\n");
+  for (unsigned k = 0; k < sizeof fix_bench_ops / sizeof fix_bench_ops[0]; k++) {
+    const struct fix_bench_op *op = &fix_bench_ops[k];
+    unsigned span = (unsigned)(op->hi - op->lo), e_fix = 0, e_flt = 0;
+
+    for (int i = 0; i < FIX_BENCH_N; i++) {
+      seed = seed * 1103515245u + 12345u;
+      a[i] = op->lo + (fix16_t)((seed >> 1) % span);
+      seed = seed * 1103515245u + 12345u;
+      b[i] = op->lo + (fix16_t)((seed >> 1) % span);
+      fa[i] = fix16_to_float(a[i]);
+      fb[i] = fix16_to_float(b[i]);
+    }
+
+    t0 = read_mcycle();
+    for (int i = 0; i < FIX_BENCH_N; i++)
+      r[i] = op->fix(a[i], b[i]);
+    t_fix = read_mcycle() - t0;
+
+    t0 = read_mcycle();
+    for (int i = 0; i < FIX_BENCH_N; i++)
+      fr[i] = op->flt(fa[i], fb[i]);
+    t_flt = read_mcycle() - t0;
+
+    for (int i = 0; i < FIX_BENCH_N; i++) {
+      double want = op->ref(fix16_to_double(a[i]), fix16_to_double(b[i]));
+      unsigned e = fb_err(fix16_to_double(r[i]), want);
+
+      if (e > e_fix)
+        e_fix = e;
+      e = fb_err((double)fr[i], want);
+      if (e > e_flt)
+        e_flt = e;
+    }
+
+    print("fix_bench: ");
+    print(op->name);
+    print_col(t_fix / FIX_BENCH_N, 12);
+    print_col(t_flt / FIX_BENCH_N, 7);
+    fb_tenths(e_fix, 13);
+    fb_tenths(e_flt, 5);
+    printc('\n');
+  }
+
+  t0 = read_mcycle();
+  for (int i = 0; i < FIX_BENCH_N; i++)
+    fr[i] = fix16_to_float(a[i]);
+  t_fix = read_mcycle() - t0;
+  t0 = read_mcycle();
+  for (int i = 0; i < FIX_BENCH_N; i++)
+    fr[i] = (float)a[i] * (1.0f / 65536);
+  t_flt = read_mcycle() - t0;
+  print("fix_bench: to float");
+  print_col(t_fix / FIX_BENCH_N, 9);
+  print_col(t_flt / FIX_BENCH_N, 7);
+  printc('\n');
+
+  t0 = read_mcycle();
+  for (int i = 0; i < FIX_BENCH_N; i++)
+    r[i] = fix16_from_float(fr[i]);
+  t_fix = read_mcycle() - t0;
+  t0 = read_mcycle();
+  for (int i = 0; i < FIX_BENCH_N; i++)
+    r[i] = (fix16_t)(fr[i] * 65536.0f);
+  t_flt = read_mcycle() - t0;
+  print("fix_bench: from float");
+  print_col(t_fix / FIX_BENCH_N, 7);
+  print_col(t_flt / FIX_BENCH_N, 7);
+  printc('\n');
+}
+#endif
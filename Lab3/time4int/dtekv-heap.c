@@ -0,0 +1,508 @@
+/* dtekv-heap.c
+   The heap region is handed out from its low end by heap_sbrk(); the
+   arenas, pools and first-fit heap each keep what they got from it. The
+   first-fit free list is kept in address order so a freed block can be
+   merged with both neighbours in the same walk that finds its place. */
+
+#include "dtekv-heap.h"
+#include "dtekv-boot.h"
+#include "dtekv-fmt.h"
+
+#define HEAP_ROUND(n)  (((n) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1u))
+
+/* Next free byte of the region, 0 until the first heap_sbrk(). */
+static char *heap_next;
+
+static struct arena *heap_arenas;
+static struct pool *heap_pools;
+
+static const char *const heap_class_names[HEAP_CLASSES] = {
+  "heap16", "heap32", "heap64", "heap128",
+  "heap256", "heap512", "heap1024", "heap2048"
+};
+
+#define HEAP_CLASS(i)  { 0, HEAP_CLASS_MIN << (i), 0, 0, 0, 0, 0, 0, 0, 0 }
+
+static struct pool heap_class[HEAP_CLASSES] = {
+  HEAP_CLASS(0), HEAP_CLASS(1), HEAP_CLASS(2), HEAP_CLASS(3),
+  HEAP_CLASS(4), HEAP_CLASS(5), HEAP_CLASS(6), HEAP_CLASS(7)
+};
+
+/* A first-fit block: the header of an allocated block keeps only its
+   size; a free one is also on the list. size includes the header. */
+struct ff_block {
+  unsigned size;
+  struct ff_block *next;
+};
+
+#define FF_HDR  HEAP_ROUND(sizeof(unsigned))
+
+static struct ff_block *ff_list;
+static struct ff_stats ff_st;
+
+void *heap_sbrk(unsigned size)
+{
+  unsigned mie = irq_save();
+  unsigned avail;
+  char *p;
+
+  if (!heap_next)
+    heap_next = __heap_start;
+  avail = (unsigned)(__heap_end - heap_next);
+  /* size first: rounding a size near 2^32 up would wrap it to 0 */
+  if (size > avail || HEAP_ROUND(size) > avail) {
+    irq_restore(mie);
+    return 0;
+  }
+  p = heap_next;
+  heap_next += HEAP_ROUND(size);
+  irq_restore(mie);
+  return p;
+}
+
+unsigned heap_sbrk_free(void)
+{
+  return (unsigned)(__heap_end - (heap_next ? heap_next : __heap_start));
+}
+
+int arena_init(struct arena *a, const char *name, unsigned size)
+{
+  a->base = heap_sbrk(size);
+  if (!a->base)
+    return -1;
+  a->ptr = a->base;
+  a->end = a->base + HEAP_ROUND(size);
+  a->peak = 0;
+  a->fails = 0;
+  a->name = name;
+  a->next = heap_arenas;
+  heap_arenas = a;
+  return 0;
+}
+
+/* Thread n blocks starting at mem onto p's free list. Interrupts masked. */
+static void pool_add(struct pool *p, char *mem, unsigned n)
+{
+  for (unsigned i = 0; i < n; i++, mem += p->block) {
+    *(void **)mem = p->free;
+    p->free = mem;
+  }
+  p->count += n;
+}
+
+int pool_init(struct pool *p, const char *name, unsigned block,
+              unsigned count, unsigned grow)
+{
+  char *mem = 0;
+
+  if (block > heap_sbrk_free())
+    return -1;
+  if (block < sizeof(void *))
+    block = sizeof(void *);
+  block = HEAP_ROUND(block);
+  if (count) {
+    if (count > heap_sbrk_free() / block)
+      return -1;
+    mem = heap_sbrk(block * count);
+    if (!mem)
+      return -1;
+  }
+  p->free = 0;
+  p->block = block;
+  p->grow = grow;
+  p->count = 0;
+  p->used = 0;
+  p->peak = 0;
+  p->fails = 0;
+  p->bytes = 0;
+  p->name = name;
+  pool_add(p, mem, count);
+  p->next = heap_pools;
+  heap_pools = p;
+  return 0;
+}
+
+/* function: pool_alloc_slow
+   Description: Another interrupt handler may have refilled the list
+   since pool_alloc() found it empty, so look again with interrupts
+   masked before taking grow blocks from the region. */
+void *pool_alloc_slow(struct pool *p)
+{
+  unsigned mie = irq_save();
+  void **b = p->free;
+
+  if (!b && p->grow && p->grow <= heap_sbrk_free() / p->block) {
+    char *mem = heap_sbrk(p->block * p->grow);
+
+    if (mem) {
+      pool_add(p, mem, p->grow);
+      b = p->free;
+    }
+  }
+  if (b) {
+    p->free = *b;
+    if (++p->used > p->peak)
+      p->peak = p->used;
+  } else {
+    p->fails++;
+  }
+  irq_restore(mie);
+  return b;
+}
+
+/* Size class of size: the smallest i with HEAP_CLASS_MIN << i >= size. */
+static unsigned heap_class_of(unsigned size)
+{
+  unsigned i = 0;
+
+  for (size = (size - 1) / HEAP_CLASS_MIN; size; size >>= 1)
+    i++;
+  return i;
+}
+
+/* function: heap_alloc
+   Description: A class grows by HEAP_CLASS_CHUNK bytes, or one block
+   if that is bigger, the first time and every time it runs dry. */
+void *heap_alloc(unsigned size)
+{
+  struct pool *p;
+  void *b;
+
+  if (size == 0 || size > HEAP_CLASS_MAX)
+    return 0;
+  p = &heap_class[heap_class_of(size)];
+  if (!p->grow) {
+    unsigned mie = irq_save();
+
+    if (!p->grow) {
+      p->grow = p->block < HEAP_CLASS_CHUNK ? HEAP_CLASS_CHUNK / p->block : 1;
+      p->name = heap_class_names[p - heap_class];
+    }
+    irq_restore(mie);
+  }
+  b = pool_alloc(p);
+  if (b) {
+    unsigned mie = irq_save();
+    p->bytes += size;
+    irq_restore(mie);
+  }
+  return b;
+}
+
+void heap_free(void *b, unsigned size)
+{
+  struct pool *p = &heap_class[heap_class_of(size)];
+  unsigned mie = irq_save();
+
+  *(void **)b = p->free;
+  p->free = b;
+  p->used--;
+  p->bytes -= size;
+  irq_restore(mie);
+}
+
+int ff_init(unsigned size)
+{
+  struct ff_block *b;
+
+  if (size < 2 * FF_HDR || ff_st.size)
+    return -1;
+  b = heap_sbrk(size);
+  if (!b)
+    return -1;
+  size = HEAP_ROUND(size);
+  b->size = size;
+  b->next = 0;
+  ff_list = b;
+  ff_st.size = size;
+  return 0;
+}
+
+/* function: ff_alloc
+   Description: The first free block that is big enough; what is left
+   of it stays on the list in its place if it can hold a header and a
+   little more, else the whole block goes. */
+void *ff_alloc(unsigned size)
+{
+  unsigned mie = irq_save();
+  struct ff_block **pp = &ff_list, *b;
+  unsigned need;
+
+  if (size > ff_st.size) {          /* could not fit, and need would wrap */
+    ff_st.fails++;
+    irq_restore(mie);
+    return 0;
+  }
+  need = FF_HDR + HEAP_ROUND(size ? size : 1);
+  while ((b = *pp) && b->size < need)
+    pp = &b->next;
+  if (!b) {
+    ff_st.fails++;
+    irq_restore(mie);
+    return 0;
+  }
+  if (b->size - need >= 2 * FF_HDR) {
+    struct ff_block *rest = (struct ff_block *)((char *)b + need);
+
+    rest->size = b->size - need;
+    rest->next = b->next;
+    *pp = rest;
+    b->size = need;
+  } else {
+    *pp = b->next;
+  }
+  ff_st.used += b->size;
+  if (ff_st.used > ff_st.peak)
+    ff_st.peak = ff_st.used;
+  irq_restore(mie);
+  return (char *)b + FF_HDR;
+}
+
+void ff_free(void *p)
+{
+  struct ff_block *b = (struct ff_block *)((char *)p - FF_HDR);
+  unsigned mie = irq_save();
+  struct ff_block **pp = &ff_list, *prev = 0;
+
+  ff_st.used -= b->size;
+  while (*pp && *pp < b) {
+    prev = *pp;
+    pp = &prev->next;
+  }
+  b->next = *pp;
+  *pp = b;
+  if (b->next && (char *)b + b->size == (char *)b->next) {
+    b->size += b->next->size;
+    b->next = b->next->next;
+  }
+  if (prev && (char *)prev + prev->size == (char *)b) {
+    prev->size += b->size;
+    prev->next = b->next;
+  }
+  irq_restore(mie);
+}
+
+void ff_get_stats(struct ff_stats *st)
+{
+  unsigned mie = irq_save();
+
+  *st = ff_st;
+  st->free_blocks = 0;
+  st->largest = 0;
+  for (struct ff_block *b = ff_list; b; b = b->next) {
+    st->free_blocks++;
+    if (b->size > st->largest)
+      st->largest = b->size;
+  }
+  irq_restore(mie);
+}
+
+/* part / whole in whole percent, both below 2^32 / 100. */
+static void heap_pct(unsigned part, unsigned whole)
+{
+  print_col(whole ? part * 100u / whole : 0, 4);
+  printc('%');
+}
+
+static void heap_pool_line(const struct pool *p)
+{
+  print_name(p->name, 10);
+  print_col(p->block, 7);
+  print_col(p->used, 7);
+  print_col(p->peak, 7);
+  print_col(p->count, 7);
+  print_col(p->fails, 6);
+  if (p->bytes) {
+    print("  frag");
+    heap_pct(p->used * p->block - p->bytes, p->used * p->block);
+  }
+  printc('\n');
+}
+
+/* function: heap_report
+   Description: For the size classes, frag is the share of the bytes in
+   their used blocks that were not asked for; for the first-fit heap it
+   is the share of the free bytes outside the largest free block. */
+void heap_report(void)
+{
+  struct ff_stats ff;
+
+  print("\nheap: ");
+  print_dec((unsigned)((heap_next ? heap_next : __heap_start) - __heap_start));
+  print(" of ");
+  print_dec((unsigned)(__heap_end - __heap_start));
+  print(" bytes taken\n");
+
+  if (heap_arenas)
+    print("arena         used   peak   size  fails\n");
+  for (struct arena *a = heap_arenas; a; a = a->next) {
+    print_name(a->name, 10);
+    print_col((unsigned)(a->ptr - a->base), 7);
+    print_col(a->peak, 7);
+    print_col((unsigned)(a->end - a->base), 7);
+    print_col(a->fails, 7);
+    printc('\n');
+  }
+
+  print("pool        block   used   peak blocks fails\n");
+  for (struct pool *p = heap_pools; p; p = p->next)
+    heap_pool_line(p);
+  for (unsigned i = 0; i < HEAP_CLASSES; i++)
+    if (heap_class[i].count || heap_class[i].fails)
+      heap_pool_line(&heap_class[i]);
+
+  ff_get_stats(&ff);
+  if (ff.size) {
+    unsigned free = ff.size - ff.used;
+
+    print("first fit: ");
+    print_dec(ff.used);
+    print(" used, peak ");
+    print_dec(ff.peak);
+    print(", ");
+    print_dec(free);
+    print(" free in ");
+    print_dec(ff.free_blocks);
+    print(" blocks, frag");
+    heap_pct(free - ff.largest, free);
+    print(", fails ");
+    print_dec(ff.fails);
+    printc('\n');
+  }
+}
+
+#ifdef DTEKV_BENCH
+#define HEAP_BENCH_N 64
+
+/* function: heap_selftest
+   Description: Sizes within HEAP_ALIGN - 1 of 2^32, which would wrap
+   when rounded up, and pool sizes whose block * count product wraps,
+   must each fail without taking anything from the region. */
+void heap_selftest(void)
+{
+  static struct arena a;
+  static struct pool p;
+  const unsigned huge = ~0u - (HEAP_ALIGN - 2);       /* 0xFFFFFFF9 */
+  unsigned bad = 0, cases = 0, before, fails;
+
+  ff_init(256);                       /* unless heap_bench() already did */
+
+  before = heap_sbrk_free();
+  bad += heap_sbrk(huge) != 0 || heap_sbrk_free() != before;
+  cases++;
+
+  if (arena_init(&a, "selftest", 64) < 0)
+    bad++;
+  else {
+    bad += arena_alloc(&a, huge) != 0 || a.ptr != a.base || a.fails != 1;
+    bad += arena_alloc(&a, 64) != a.base || arena_alloc(&a, 1) != 0;
+  }
+  cases += 2;
+
+  fails = ff_st.fails;
+  before = ff_st.used;
+  bad += ff_alloc(huge) != 0 || ff_st.fails != fails + 1 || ff_st.used != before;
+  cases++;
+
+  before = heap_sbrk_free();
+  bad += pool_init(&p, "selftest", 16, 0x10000001u, 0) == 0;   /* 16 * n wraps to 16 */
+  bad += pool_init(&p, "selftest", huge, 1, 0) == 0;
+  bad += heap_sbrk_free() != before;
+  cases += 3;
+
+  if (pool_init(&p, "selftest", 16, 0, 0x10000001u) < 0)       /* grows by a wrapping amount */
+    bad++;
+  else
+    bad += pool_alloc(&p) != 0 || p.fails != 1 || heap_sbrk_free() != before;
+  cases++;
+
+  print(bad ? "heap_selftest: FAILED, mismatches=" : "heap_selftest: ok, cases=");
+  print_dec(bad ? bad : cases);
+  print("\n");
+}
+
+/* function: heap_bench
+   Description: Average cycles for an allocation and for a free with
+   each allocator, HEAP_BENCH_N at a time: arena_alloc() and one
+   release, pool_alloc()/pool_free(), heap_alloc()/heap_free() over
+   mixed sizes, and ff_alloc()/ff_free() over the same sizes, freed in
+   an order that leaves holes to merge. Then heap_report(). */
+void heap_bench(void)
+{
+  static struct arena a;
+  static struct pool p;
+  static void *blk[HEAP_BENCH_N];
+  unsigned size[HEAP_BENCH_N], seed = 12345u, t0, t_alloc, t_free;
+  void *mark;
+
+  if (arena_init(&a, "bench", 64 * HEAP_BENCH_N) < 0
+      || pool_init(&p, "bench", 24, HEAP_BENCH_N, 0) < 0
+      || ff_init(64 * 1024) < 0) {
+    print("heap_bench: no room\n");
+    return;
+  }
+  for (int i = 0; i < HEAP_BENCH_N; i++) {
+    seed = seed * 1103515245u + 12345u;
+    size[i] = 8 + (seed >> 16) % 500;
+  }
+
+  mark = arena_mark(&a);
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i++)
+    blk[i] = arena_alloc(&a, 40);
+  t_alloc = read_mcycle() - t0;
+  t0 = read_mcycle();
+  arena_release(&a, mark);
+  t_free = read_mcycle() - t0;
+  print("heap_bench: cycles/op arena alloc=");
+  print_dec(t_alloc / HEAP_BENCH_N);
+  print(" release(all)=");
+  print_dec(t_free);
+
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i++)
+    blk[i] = pool_alloc(&p);
+  t_alloc = read_mcycle() - t0;
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i++)
+    pool_free(&p, blk[i]);
+  t_free = read_mcycle() - t0;
+  print("\nheap_bench: cycles/op pool alloc=");
+  print_dec(t_alloc / HEAP_BENCH_N);
+  print(" free=");
+  print_dec(t_free / HEAP_BENCH_N);
+
+  for (int i = 0; i < HEAP_BENCH_N; i++)     /* let every class grow once */
+    heap_free(heap_alloc(size[i]), size[i]);
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i++)
+    blk[i] = heap_alloc(size[i]);
+  t_alloc = read_mcycle() - t0;
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i++)
+    heap_free(blk[i], size[i]);
+  t_free = read_mcycle() - t0;
+  print("\nheap_bench: cycles/op heap_alloc=");
+  print_dec(t_alloc / HEAP_BENCH_N);
+  print(" heap_free=");
+  print_dec(t_free / HEAP_BENCH_N);
+
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i++)
+    blk[i] = ff_alloc(size[i]);
+  t_alloc = read_mcycle() - t0;
+  t0 = read_mcycle();
+  for (int i = 0; i < HEAP_BENCH_N; i += 2)
+    ff_free(blk[i]);
+  for (int i = 1; i < HEAP_BENCH_N; i += 2)
+    ff_free(blk[i]);
+  t_free = read_mcycle() - t0;
+  print("\nheap_bench: cycles/op ff_alloc=");
+  print_dec(t_alloc / HEAP_BENCH_N);
+  print(" ff_free=");
+  print_dec(t_free / HEAP_BENCH_N);
+  printc('\n');
+
+  heap_report();
+}
+#endif
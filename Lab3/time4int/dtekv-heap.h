@@ -0,0 +1,179 @@
+#ifndef DTEKV_HEAP_H
+#define DTEKV_HEAP_H
+
+/* Allocators over the heap region of dtekv-script.lds: __heap_start ..
+   __heap_end, all the RAM between the program and the task stacks.
+
+     static struct arena scratch;
+     arena_init(&scratch, "scratch", 4096);
+     void *m = arena_mark(&scratch);
+     buf = arena_alloc(&scratch, n);       ...use buf
+     arena_release(&scratch, m);           frees buf and all after it
+
+     static struct pool msgs;
+     pool_init(&msgs, "msgs", sizeof(struct msg), 32, 0);
+     struct msg *m = pool_alloc(&msgs);    ...
+     pool_free(&msgs, m);
+
+     p = heap_alloc(100);                  a block of the 128-byte class
+     heap_free(p, 100);
+
+   Each allocator takes memory from the low end of the region with
+   heap_sbrk() and never gives it back:
+   - an arena hands out memory by bumping a pointer and frees everything
+     above a mark at once; it belongs to one thread;
+   - a pool hands out blocks of one size from a free list. heap_alloc()
+     keeps one pool per power-of-two size class up to HEAP_CLASS_MAX and
+     grows a class by HEAP_CLASS_CHUNK bytes when it runs dry;
+   - ff_alloc() is first fit over an address-ordered free list that
+     coalesces on free, for sizes and lifetimes the others do not suit.
+     It is only linked in if used.
+   Pools, heap_alloc() and ff_alloc() mask interrupts while they change
+   their lists, so interrupt handlers may use them too. */
+
+/* Alignment of every allocation. */
+#define HEAP_ALIGN      8
+
+/* heap_alloc() size classes: HEAP_CLASS_MIN << i up to HEAP_CLASS_MAX. */
+#define HEAP_CLASS_MIN  16
+#define HEAP_CLASS_MAX  2048
+#define HEAP_CLASSES    8
+
+/* Bytes a size class takes from the region at a time (at least one
+   block). */
+#ifndef HEAP_CLASS_CHUNK
+#define HEAP_CLASS_CHUNK 4096
+#endif
+
+#include "dtekv-lib.h"
+
+/* Take size bytes (rounded up to HEAP_ALIGN) from the region for good.
+   Returns 0 if it does not have them. */
+void *heap_sbrk(unsigned size);
+
+/* Bytes of the region not taken by heap_sbrk() yet. */
+unsigned heap_sbrk_free(void);
+
+struct arena {
+  char *base;
+  char *ptr;                    /* next free byte */
+  char *end;
+  unsigned peak;                /* most bytes ever in use, as of the last release */
+  unsigned fails;
+  const char *name;
+  struct arena *next;           /* every arena, for heap_report() */
+};
+
+/* Give a an area of size bytes. Returns 0, or -1 if the region is full. */
+int arena_init(struct arena *a, const char *name, unsigned size);
+
+/* The room left is a multiple of HEAP_ALIGN, so a size that fits still
+   fits rounded up, and one near 2^32 is turned away before rounding can
+   wrap it. */
+static inline void *arena_alloc(struct arena *a, unsigned size)
+{
+  char *p = a->ptr;
+
+  if (size > (unsigned)(a->end - p)) {
+    a->fails++;
+    return 0;
+  }
+  a->ptr = p + ((size + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1u));
+  return p;
+}
+
+static inline void *arena_mark(struct arena *a)
+{
+  return a->ptr;
+}
+
+/* Free everything allocated since arena_mark() returned mark. */
+static inline void arena_release(struct arena *a, void *mark)
+{
+  unsigned used = (unsigned)(a->ptr - a->base);
+
+  if (used > a->peak)
+    a->peak = used;
+  a->ptr = mark;
+}
+
+struct pool {
+  void *free;                   /* free blocks, linked through their first word */
+  unsigned block;               /* block size */
+  unsigned grow;                /* blocks to add when empty, 0 for a fixed pool */
+  unsigned count;               /* blocks owned */
+  unsigned used;
+  unsigned peak;
+  unsigned fails;
+  unsigned bytes;               /* bytes asked for, heap_alloc() classes only */
+  const char *name;
+  struct pool *next;            /* every pool, for heap_report() */
+};
+
+/* Make p a pool of count blocks of block bytes (rounded up to
+   HEAP_ALIGN) that adds grow more whenever it runs out; count may be 0
+   if grow is not. Returns 0, or -1 if the region is full. */
+int pool_init(struct pool *p, const char *name, unsigned block,
+              unsigned count, unsigned grow);
+
+/* Grow p, or count a failure; pool_alloc() when the free list is empty. */
+void *pool_alloc_slow(struct pool *p);
+
+static inline void *pool_alloc(struct pool *p)
+{
+  unsigned mie = irq_save();
+  void **b = p->free;
+
+  if (b) {
+    p->free = *b;
+    if (++p->used > p->peak)
+      p->peak = p->used;
+  }
+  irq_restore(mie);
+  return b ? (void *)b : pool_alloc_slow(p);
+}
+
+static inline void pool_free(struct pool *p, void *b)
+{
+  unsigned mie = irq_save();
+
+  *(void **)b = p->free;
+  p->free = b;
+  p->used--;
+  irq_restore(mie);
+}
+
+/* A block of the smallest size class that holds size bytes, or 0 if
+   size is 0 or above HEAP_CLASS_MAX or the region is full. heap_free()
+   takes the size that was asked for. */
+void *heap_alloc(unsigned size);
+void heap_free(void *p, unsigned size);
+
+/* First fit: ff_init() gives it size bytes; until then ff_alloc()
+   fails. ff_free() takes the pointer alone. */
+int ff_init(unsigned size);
+void *ff_alloc(unsigned size);
+void ff_free(void *p);
+
+struct ff_stats {
+  unsigned size;                /* bytes given to ff_init() */
+  unsigned used;                /* in allocated blocks, headers included */
+  unsigned peak;
+  unsigned free_blocks;         /* pieces the free space is split into */
+  unsigned largest;             /* largest free block */
+  unsigned fails;
+};
+
+void ff_get_stats(struct ff_stats *st);
+
+/* Region use, then one line per arena, pool and size class in use with
+   its use, peak and failures, and for the first-fit heap the share of
+   its free space that is not in its largest block. */
+void heap_report(void);
+
+#ifdef DTEKV_BENCH
+void heap_selftest(void);
+void heap_bench(void);
+#endif
+
+#endif
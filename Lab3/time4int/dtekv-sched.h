@@ -0,0 +1,117 @@
+#ifndef DTEKV_SCHED_H
+#define DTEKV_SCHED_H
+
+/* Cooperative tasks with earliest-deadline-first dispatch.
+
+     static struct task t_prime, t_clock;
+     timer_init(TIMER_TICKLESS, 0);
+     task_create(&t_prime, "prime", prime_task, 0, 4096, TIMER_MS(100));
+     task_create(&t_clock, "clock", clock_task, 0, 1024, TIMER_MS(1));
+     enable_interrupt();
+     sched_start();                        never returns
+
+   A task runs until it calls yield(), sleep_until() or returns; nothing
+   preempts it. Whenever a task becomes ready (it is created, yields or
+   wakes up) its deadline is set to the time plus its rel_deadline, and
+   the ready task with the earliest deadline runs next, so a task with a
+   short rel_deadline that wakes up goes ahead of a long computation the
+   moment that computation yields. Ties run in the order they became
+   ready, which makes equal rel_deadlines round-robin.
+
+   Time is timer_now() of the interval timer, so timer_init() must have
+   run. With no task ready the CPU waits in wfi for the earliest
+   sleeper's one-shot timer. Stacks come from the task stack region of
+   dtekv-script.lds; interrupts taken in a task push their frame on its
+   stack, so a stack must have room for the deepest nested interrupt.
+
+   The context switch is a function call (dtekv-switch.S): only ra, sp
+   and s0-s11 are saved. Tasks must not yield inside a PROF region, and
+   nothing here may be called from an interrupt handler. */
+
+/* Bytes of the saved context at the top of a suspended task's stack:
+   ra and s0-s11, rounded up to keep sp 16-byte aligned. The offsets are
+   the ones task_create() fills in for a task that has not run yet. */
+#define TASK_CTX_SIZE  64
+#define TASK_CTX_RA    0
+#define TASK_CTX_S0    4
+#define TASK_CTX_S1    8
+
+#ifndef __ASSEMBLER__
+
+#include "dtekv-timer.h"
+
+/* Smallest stack task_create() accepts: the context, a trap frame for
+   every interrupt priority level and a little to run on. */
+#define TASK_STACK_MIN 1024
+
+enum task_state {
+  TASK_READY,       /* on the ready queue, or running */
+  TASK_SLEEPING,    /* on the sleep queue until its wake time */
+  TASK_DONE         /* its function returned */
+};
+
+typedef void (*task_fn_t)(unsigned arg);
+
+/* A task control block. The caller provides the storage, which must
+   stay valid for as long as the scheduler runs. */
+struct task {
+  unsigned sp;                    /* saved stack pointer; first member */
+  const char *name;
+  enum task_state state;
+  unsigned rel_deadline;          /* timer cycles from ready to deadline */
+  unsigned long long key;         /* deadline when ready, wake time asleep */
+  struct task *next;              /* ready or sleep queue */
+  struct task *all;               /* every task, for sched_report() */
+  unsigned *stack_lo;             /* lowest word holds a canary */
+  unsigned stack_size;
+  unsigned long long cycles;      /* mcycle spent running */
+  unsigned runs;                  /* times it was switched to */
+  unsigned run_max;               /* longest run between switches */
+  unsigned late_max;              /* timer cycles past its deadline at a switch */
+};
+
+struct sched_stats {
+  unsigned switches;              /* context switches */
+  unsigned switch_min;            /* cycles of the quickest yield() to another task */
+  unsigned long long idle;        /* mcycle spent with nothing ready */
+  unsigned stack_free;            /* bytes left in the task stack region */
+};
+
+/* Set up t to run fn(arg) with a stack of stack_size bytes (rounded up
+   to 16) and put it on the ready queue. Returns 0, or -1 if the stack
+   is smaller than TASK_STACK_MIN or the region has no room left. */
+int task_create(struct task *t, const char *name, task_fn_t fn, unsigned arg,
+                unsigned stack_size, unsigned rel_deadline);
+
+/* Run the ready tasks; returns only if none was ever created. Call from
+   main once the tasks exist and interrupts are enabled. */
+void sched_start(void);
+
+/* Give the CPU to the task with the earliest deadline. The caller gets a
+   new deadline, so it only keeps running if it is still the earliest. */
+void yield(void);
+
+/* Sleep until timer_now() >= t. A time in the past just yields. */
+void sleep_until(unsigned long long t);
+
+/* The running task, or 0 before sched_start(). */
+struct task *task_current(void);
+
+/* End the calling task; what returning from its function does. */
+void task_exit(void);
+
+void sched_get_stats(struct sched_stats *st);
+
+/* One line per task: runs, share of the CPU, longest run, worst
+   lateness, stack used, then the idle share. */
+void sched_report(void);
+
+/* Sleep for ticks timer cycles. */
+static inline void sleep_for(unsigned long long ticks)
+{
+  sleep_until(timer_now() + ticks);
+}
+
+#endif
+
+#endif
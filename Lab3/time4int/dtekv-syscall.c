@@ -0,0 +1,171 @@
+/* dtekv-syscall.c
+   The system calls behind ecall. boot.S jumps through syscall_table, or
+   returns -1 for an empty or missing slot; everything here is an
+   ordinary C function with a0-a5 as arguments. print and putchar have
+   no result and return their a0, which the caller gets back unchanged.
+   print, write and writev can queue a lot of output, so they are
+   SYSCALL_LONG. */
+
+#include "dtekv-syscall.h"
+#include "dtekv-lib.h"
+
+#ifdef DTEKV_BENCH
+volatile unsigned syscall_count;
+#endif
+
+static int do_print(unsigned s, unsigned a1, unsigned a2,
+                    unsigned a3, unsigned a4, unsigned a5)
+{
+  print((const char *)s);
+  return (int)s;
+}
+
+static int do_putchar(unsigned c, unsigned a1, unsigned a2,
+                      unsigned a3, unsigned a4, unsigned a5)
+{
+  printc((char)c);
+  return (int)c;
+}
+
+static int do_write(unsigned fd, unsigned buf, unsigned len,
+                    unsigned a3, unsigned a4, unsigned a5)
+{
+  if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
+    return -1;
+  uart_write((const char *)buf, len);
+  return (int)len;
+}
+
+static int do_writev(unsigned fd, unsigned iov, unsigned count,
+                     unsigned a3, unsigned a4, unsigned a5)
+{
+  const struct iovec *v = (const struct iovec *)iov;
+  unsigned n = 0;
+
+  if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
+    return -1;
+  for (unsigned i = 0; i < count; i++) {
+    uart_write(v[i].base, v[i].len);
+    n += v[i].len;
+  }
+  return (int)n;
+}
+
+syscall_fn_t syscall_table[SYSCALL_TABLE_SIZE] = {
+  [SYS_print] = SYSCALL_LONG_FN(do_print),
+  [SYS_putchar] = do_putchar,
+  [SYS_write] = SYSCALL_LONG_FN(do_write),
+  [SYS_writev] = SYSCALL_LONG_FN(do_writev)
+};
+
+/* function: syscall_register
+   Description: Install fn as system call nr, replacing what was there. A
+   call in progress on another thread finishes with the old function. */
+int syscall_register(unsigned nr, syscall_fn_t fn, unsigned flags)
+{
+  if (nr >= SYSCALL_TABLE_SIZE || fn == 0)
+    return -1;
+  syscall_table[nr] = (syscall_fn_t)((char *)fn + (flags & SYSCALL_LONG));
+  return 0;
+}
+
+#ifdef DTEKV_BENCH
+/* Four lines of 32 bytes fit the transmit ring many times over, so with
+   the ring flushed first no run waits for the UART and the cycles are
+   those of the traps and the queueing. */
+#define SYSCALL_BENCH_LINES 4
+
+static const char sc_line[] = "syscall_bench: 0123456789abcdef";  /* + '\n' */
+
+static inline void sc_ecall1(unsigned nr, unsigned arg)
+{
+  register unsigned a0 asm("a0") = arg;
+  register unsigned a7 asm("a7") = nr;
+
+  asm volatile ("ecall" : "+r"(a0) : "r"(a7) : "memory");
+}
+
+static void sc_result(const char *name, unsigned cycles, unsigned traps)
+{
+  unsigned bytes = SYSCALL_BENCH_LINES * sizeof sc_line;
+
+  print(name);
+  print(" traps/line=");
+  print_dec(traps / SYSCALL_BENCH_LINES);
+  print(" cycles/byte=");
+  print_dec(cycles / bytes);
+  printc('.');
+  print_dec(cycles * 10 / bytes % 10);
+  printc('\n');
+}
+
+/* function: syscall_bench
+   Description: Print the same line a few times each way the lab code
+   has printed one: an ecall per character (analyze.S), print_string
+   plus print_char for the newline (the old display_string), and then
+   one write() and one writev() per line, with uart_write() called
+   directly as the floor. For each, the traps taken per line and the
+   cycles per byte from the first ecall to the last return. */
+void syscall_bench(void)
+{
+  static const struct iovec iov[2] = {
+    { sc_line, sizeof sc_line - 1 }, { "\n", 1 }
+  };
+  char buf[sizeof sc_line];
+  unsigned t0, c0, t[5], n[5];
+
+  for (unsigned i = 0; i < sizeof sc_line - 1; i++)
+    buf[i] = sc_line[i];
+  buf[sizeof sc_line - 1] = '\n';
+
+  flush();
+  c0 = syscall_count;
+  t0 = read_mcycle();
+  for (int r = 0; r < SYSCALL_BENCH_LINES; r++)
+    for (unsigned i = 0; i < sizeof buf; i++)
+      sc_ecall1(SYS_putchar, (unsigned char)buf[i]);
+  t[0] = read_mcycle() - t0;
+  n[0] = syscall_count - c0;
+
+  flush();
+  c0 = syscall_count;
+  t0 = read_mcycle();
+  for (int r = 0; r < SYSCALL_BENCH_LINES; r++) {
+    sc_ecall1(SYS_print, (unsigned)sc_line);
+    sc_ecall1(SYS_putchar, '\n');
+  }
+  t[1] = read_mcycle() - t0;
+  n[1] = syscall_count - c0;
+
+  flush();
+  c0 = syscall_count;
+  t0 = read_mcycle();
+  for (int r = 0; r < SYSCALL_BENCH_LINES; r++)
+    sys_write(STDOUT_FILENO, buf, sizeof buf);
+  t[2] = read_mcycle() - t0;
+  n[2] = syscall_count - c0;
+
+  flush();
+  c0 = syscall_count;
+  t0 = read_mcycle();
+  for (int r = 0; r < SYSCALL_BENCH_LINES; r++)
+    sys_writev(STDOUT_FILENO, iov, 2);
+  t[3] = read_mcycle() - t0;
+  n[3] = syscall_count - c0;
+
+  flush();
+  c0 = syscall_count;
+  t0 = read_mcycle();
+  for (int r = 0; r < SYSCALL_BENCH_LINES; r++)
+    uart_write(buf, sizeof buf);
+  t[4] = read_mcycle() - t0;
+  n[4] = syscall_count - c0;
+  flush();
+
+  sc_result("syscall_bench: putchar/char", t[0], n[0]);
+  sc_result("syscall_bench: print+putchar", t[1], n[1]);
+  sc_result("syscall_bench: write", t[2], n[2]);
+  sc_result("syscall_bench: writev", t[3], n[3]);
+  sc_result("syscall_bench: uart_write", t[4], n[4]);
+}
+#endif
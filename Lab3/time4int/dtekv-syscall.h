@@ -0,0 +1,95 @@
+#ifndef DTEKV_SYSCALL_H
+#define DTEKV_SYSCALL_H
+
+/* System calls: ecall with the number in a7 and arguments in a0-a5.
+
+     li a0, 1; la a1, msg; li a2, 12; li a7, SYS_write; ecall
+     ...or from C:    sys_write(1, msg, 12);
+
+   boot.S takes every ecall straight to syscall_table[a7], without the
+   trap frame and bookkeeping of an interrupt. As in RARS, an ecall
+   changes no register but a0, and a0 only for a call with a result
+   (write, writev); print and putchar leave it alone. Handlers run with
+   interrupts off, except those tagged SYSCALL_LONG, which run with the
+   caller's interrupt enable so that a long write does not hold off
+   interrupts. An ecall must not be made from an interrupt handler.
+
+   write() and writev() hand a whole buffer to the UART in one trap; a
+   line printed one character per ecall costs a trap per byte. */
+
+#define SYS_print     4     /* a0: NUL-terminated string (RARS print_string) */
+#define SYS_putchar   11    /* a0: character (RARS print_char) */
+#define SYS_write     64    /* a0: fd, a1: buf, a2: len */
+#define SYS_writev    66    /* a0: fd, a1: struct iovec *, a2: count */
+
+/* Numbers below this index syscall_table; the rest return -1. */
+#define SYSCALL_TABLE_SIZE (SYS_writev + 1)
+
+/* Tag in bit 0 of a syscall_table entry: the handler may run long
+   enough that interrupts should stay on. boot.S clears it before the
+   call; handlers are word aligned, so the bit is otherwise 0. */
+#define SYSCALL_LONG  1
+
+/* File descriptors write() accepts; both go to the JTAG UART. */
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+
+#ifndef __ASSEMBLER__
+
+struct iovec {
+  const void *base;
+  unsigned len;
+};
+
+typedef int (*syscall_fn_t)(unsigned a0, unsigned a1, unsigned a2,
+                            unsigned a3, unsigned a4, unsigned a5);
+
+/* An entry tagged SYSCALL_LONG, for the table's initialiser. */
+#define SYSCALL_LONG_FN(fn)  ((syscall_fn_t)((char *)(fn) + SYSCALL_LONG))
+
+/* Empty (0) entries return -1. Entries may carry SYSCALL_LONG, so call
+   them only through ecall. */
+extern syscall_fn_t syscall_table[SYSCALL_TABLE_SIZE];
+
+#ifdef DTEKV_BENCH
+/* ecalls taken, counted by boot.S in bench builds. */
+extern volatile unsigned syscall_count;
+#endif
+
+/* Put fn in slot nr; flags is 0 or SYSCALL_LONG. fn's return value goes
+   to the caller's a0, so a call without a result returns its a0. Returns
+   0, or -1 if nr is out of range. */
+int syscall_register(unsigned nr, syscall_fn_t fn, unsigned flags);
+
+/* Write len bytes from buf to fd. Returns len, or -1 for a bad fd. */
+static inline int sys_write(int fd, const void *buf, unsigned len)
+{
+  register unsigned a0 asm("a0") = (unsigned)fd;
+  register unsigned a1 asm("a1") = (unsigned)buf;
+  register unsigned a2 asm("a2") = len;
+  register unsigned a7 asm("a7") = SYS_write;
+
+  asm volatile ("ecall" : "+r"(a0) : "r"(a1), "r"(a2), "r"(a7) : "memory");
+  return (int)a0;
+}
+
+/* Write count buffers in order, in one trap. Returns the bytes written,
+   or -1 for a bad fd. */
+static inline int sys_writev(int fd, const struct iovec *iov, unsigned count)
+{
+  register unsigned a0 asm("a0") = (unsigned)fd;
+  register unsigned a1 asm("a1") = (unsigned)iov;
+  register unsigned a2 asm("a2") = count;
+  register unsigned a7 asm("a7") = SYS_writev;
+
+  asm volatile ("ecall" : "+r"(a0) : "r"(a1), "r"(a2), "r"(a7) : "memory");
+  return (int)a0;
+}
+
+#ifdef DTEKV_BENCH
+void syscall_bench(void);
+#endif
+
+#endif
+
+#endif
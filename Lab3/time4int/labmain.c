@@ -1,14 +1,26 @@
 /* labmain.c  — primes + timer interrupt updates to HEX display */
 
 #include <stdint.h>
+#include "dtekv-lib.h"
+#include "dtekv-irq.h"
+#include "dtekv-fmt.h"
+#include "dtekv-prime.h"
+#include "dtekv-sieve.h"
+#include "dtekv-prof.h"
+#include "dtekv-timer.h"
+#include "dtekv-hex.h"
+#include "dtekv-bcd.h"
+#include "dtekv-boot.h"
+#include "dtekv-gpio.h"
+#include "dtekv-sched.h"
+#include "dtekv-syscall.h"
+#include "dtekv-fix.h"
+#include "dtekv-heap.h"
+#include "dtekv-mem.h"
+#include "dtekv-str.h"
 
 /* ===== externs (provided) ===== */
-extern void print(const char*);
-extern void print_dec(unsigned int);
-extern void display_string(int, char*);
-extern void time2string(char*, int);
-extern void tick(int*);
-extern int nextprime(int);
+extern void display_string(char*);
 extern void enable_interrupt(void);
 
 
@@ -20,113 +32,154 @@ extern void enable_interrupt(void);
 #define HEX_BASE     0x04000050u
 #define HEX_STRIDE   0x10u
 
-
-/* ===== TIMER (Intel Interval Timer) ===== */
-#define TIMER_BASE   0x04000020u
-#define TMR_STATUS   (*(volatile unsigned int*)(TIMER_BASE + 0x00))
-#define TMR_CONTROL  (*(volatile unsigned int*)(TIMER_BASE + 0x04))
-#define TMR_PERIODL  (*(volatile unsigned int*)(TIMER_BASE + 0x08))
-#define TMR_PERIODH  (*(volatile unsigned int*)(TIMER_BASE + 0x0C))
-#define CTRL_ITO     (1u << 0)
-#define CTRL_CONT    (1u << 1)
-#define CTRL_START   (1u << 2)
-#define ST_TO        (1u << 0)
-#define TIMER_CLK_HZ 30000000u        // dtekv interval timer clock (adjust if needed)
-#define IRQ_RATE_HZ  10u  
-
 /* ===== globals from template ===== */
-int  mytime       = 0x5957;                     /* MM:SS in BCD-like nibbles */
+int  mytime       = 0x5957;                     /* HH:MM:SS, packed BCD */
 char textstring[] = "text, more text, and even more text!";
-/* count timer interrupts; do work every 10th */
-volatile int timeoutcount = 0;
-
 
 /* (b) add prime */
 int prime = 1234567;
 
-/* 7-segment digit patterns (active-low) for 0..9 */
-static const unsigned char LED_NBR[10] =
-  { 64,121,36,48,25,18,2,120,0,16 };
-
-/* one HEX digit → one display (HEX0..HEX5) */
-static inline void set_displays(int display_number, int value) {
-    if (display_number < 0 || display_number > 5) return;
-    volatile unsigned int *disp =
-        (volatile unsigned int *)(HEX_BASE + (unsigned)display_number * HEX_STRIDE);
-    unsigned int patt = (unsigned)LED_NBR[value & 0xF] | 0x80u;  /* DP off */
-    *disp = patt;
-}
-static inline void clear_display(int display_number){
-    if (display_number < 0 || display_number > 5) return;
-    volatile unsigned int *disp =
-        (volatile unsigned int *)(HEX_BASE + (unsigned)display_number * HEX_STRIDE);
-    *disp = 0xFFu; /* all segments off (active-low) */
-}
+PROF_REGION(p_clock, "clock_tick");
+PROF_REGION(p_tick, "tick");
+PROF_REGION(p_prime, "nextprime");
+
+/* ===== tasks (dtekv-sched.h) =====
+   The clock and the button get short relative deadlines, so whenever
+   one of them wakes up it runs as soon as the prime search yields. The
+   prime search yields once per PRIME_SLICE cycles, which bounds how long
+   the others wait for it. */
+#define PRIME_SLICE  30000u                     /* 1 ms at 30 MHz */
+
+static struct task t_clock, t_input, t_prime;
 
-/* init timer for 1 Hz periodic interrupts @ 30 MHz clock */
+static void clock_task(unsigned arg);
+static void input_task(unsigned arg);
+static void prime_task(unsigned arg);
+
+/* start the timer service and the tasks */
 void labinit(void) {
     /* --- any other peripheral init goes here (GPIO, display clear, etc.) --- */
 
     /* === Program the timer while global IRQs are still disabled === */
-    const uint32_t period = (TIMER_CLK_HZ / IRQ_RATE_HZ) - 1u;
+    timer_init(TIMER_TICKLESS, 0);
+    gpio_init(GPIO_BIT(GPIO_BTN), 20);
 
-    TMR_CONTROL = 0;                   /* stop/disable while programming */
-    TMR_STATUS  = 0;                   /* clear any pending timeout flag */
-    TMR_PERIODL = (uint16_t)(period & 0xFFFFu);
-    TMR_PERIODH = (uint16_t)(period >> 16);
+    task_create(&t_clock, "clock", clock_task, 0, 2048, (unsigned)TIMER_MS(1));
+    task_create(&t_input, "input", input_task, 0, 2048, (unsigned)TIMER_MS(5));
+    task_create(&t_prime, "prime", prime_task, 0, 4096, (unsigned)TIMER_MS(100));
 
-    /* Allow the timer to raise interrupts and start it (device-level enable) */
-    TMR_CONTROL = (CTRL_ITO | CTRL_CONT | CTRL_START);
+    /* Printing goes through the interrupt driven UART ring from here on */
+    uart_tx_init(UART_TX_BLOCK);
 
     /* === LAST STEP: enable interrupts globally & allow external IRQs (part g) === */
     enable_interrupt();
 }
 
-/* (d) ISR: put MM:SS from mytime on HEX and tick() the time.
-   No terminal printing here. */
-void handle_interrupt(unsigned cause) {
-    (void)cause;
+/* (d) once a second: put MM:SS from mytime on HEX and advance the time
+   with bcd_clock_inc(). The wake times stay on the 1 s grid however late
+   the task runs. The scheduler sees that the clock is due when the prime
+   search yields, so while that runs the tickless timer takes no
+   interrupts at all. */
+static void clock_task(unsigned arg) {
+    unsigned long long next = timer_now();
+    (void)arg;
 
-    /* --- acknowledge timer IRQ first --- */
-    if (TMR_STATUS & ST_TO) {
-        TMR_STATUS = 0;                 /* clear/ACK */
-    } else {
-        return;                          /* not our IRQ */
+    while (1) {
+        next += TIMER_MS(1000);
+        sleep_until(next);
+        PROF_BEGIN(p_clock);
+
+        /* --- display MM:SS from mytime on HEX; only changed digits are
+           written --- */
+        struct hex_frame f;
+        hex_frame_init(&f);
+        hex_frame_nibbles(&f, 0, 4, (unsigned)mytime);
+        hex_frame_glyph(&f, 4, HEX_BLANK);
+        hex_frame_glyph(&f, 5, HEX_BLANK);
+        hex_flush(&f);
+
+        /* advance time */
+        PROF_BEGIN(p_tick);
+        mytime = (int)bcd_clock_inc((unsigned)mytime, &bcd_clock_100h);
+        PROF_END(p_tick);
+
+        PROF_END(p_clock);
     }
+}
+
+/* BTN2 prints the task table (and the profile in a DTEKV_PROF build). */
+static void input_task(unsigned arg) {
+    (void)arg;
 
-    /* --- run once every 10 interrupts --- */
-    if (++timeoutcount < 10) {
-        return;
+    while (1) {
+        struct gpio_event ev;
+
+        sleep_for(TIMER_MS(10));
+        while (gpio_read_event(&ev)) {
+            if (ev.pin != GPIO_BTN || !ev.level)
+                continue;
+            sched_report();
+            PROF_DUMP();
+        }
     }
-    timeoutcount = 0;
-
-    /* --- display MM:SS from mytime on HEX --- */
-    int t   = mytime;
-    int m10 = (t >> 12) & 0xF;
-    int m1  = (t >> 8)  & 0xF;
-    int s10 = (t >> 4)  & 0xF;
-    int s1  =  t        & 0xF;
-
-    set_displays(0, s1);
-    set_displays(1, s10);
-    set_displays(2, m1);
-    set_displays(3, m10);
-    clear_display(4);
-    clear_display(5);
-
-    /* advance time (only every 10th IRQ) */
-    tick(&mytime);
 }
 
+/* (c) print primes forever, a slice of them at a time */
+static void prime_task(unsigned arg) {
+    unsigned slice = read_mcycle();
+    (void)arg;
 
-/* (c) new main: print primes forever */
-int main(void) {
-    labinit();
-
+#ifdef DTEKV_PROF
+    unsigned nprimes = 0;
+#endif
+    prime_stream_init(prime);
     while (1) {
         print("Prime: ");
-        prime = nextprime(prime);
+        PROF_BEGIN(p_prime);
+        prime = prime_stream_next();
+        PROF_END(p_prime);
         print_dec((unsigned)prime);
         print("\n");
+#ifdef DTEKV_PROF
+        if (++nprimes == 1000) {        /* profile table every 1000 primes */
+            nprimes = 0;
+            PROF_DUMP();
+        }
+#endif
+        if (read_mcycle() - slice >= PRIME_SLICE) {
+            yield();
+            slice = read_mcycle();
+        }
     }
 }
+
+/* Registered causes are dispatched through irq_table; nothing else is
+   enabled, so there is nothing left to do here. */
+void handle_interrupt(unsigned cause) {
+    (void)cause;
+}
+
+
+/* (c) new main: the tasks take over once the benchmarks are done */
+int main(void) {
+    boot_report();                     /* banner, boot cycles, memory map */
+    labinit();
+
+#ifdef DTEKV_BENCH
+    mem_bench();
+    str_bench();
+    fmt_bench();
+    syscall_bench();
+    timer_bench();
+    bcd_selftest();
+    bcd_bench();
+    prime_selftest();
+    prime_bench();
+    fix_bench();
+    heap_bench();
+    heap_selftest();
+#endif
+
+    sched_start();                     /* runs the tasks; never returns */
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* dtekv-boot.c
+   The C side of the startup code in boot.S. */
+
+#include "dtekv-boot.h"
+#include "dtekv-lib.h"
+
+/* Stored by _start after it has cleared .bss. */
+unsigned boot_cycle_reset;
+unsigned boot_cycle_main;
+
+/* Next free byte of the task stack region, 0 until the first alloc. */
+static char *boot_stack_next;
+
+static void boot_range(const char *what, const char *lo, const char *hi)
+{
+  print(what);
+  print_hex32((unsigned)lo);
+  print("..");
+  print_hex32((unsigned)hi);
+  print(" (");
+  print_dec((unsigned)(hi - lo));
+  print(" bytes)\n");
+}
+
+/* function: boot_report
+   Description: The banner _start used to print through an ecall, then
+   what the startup cost and where .bss, the heap and the stacks are. */
+void boot_report(void)
+{
+  print("================================================\n"
+        "===== RISC-V Boot-Up Process Now Complete ======\n"
+        "================================================\n");
+  print("boot: ");
+  print_dec(boot_cycle_main - boot_cycle_reset);
+  print(" cycles from reset to main\n");
+  boot_range("boot: bss   ", __bss_start, __bss_end);
+  boot_range("boot: heap  ", __heap_start, __heap_end);
+  boot_range("boot: tasks ", _task_stacks_begin, _task_stacks_end);
+  boot_range("boot: stack ", _stack_begin, _stack_end);
+}
+
+void *boot_stack_alloc(unsigned size)
+{
+  unsigned mie = irq_save();
+  unsigned *lo;
+
+  if (!boot_stack_next)
+    boot_stack_next = _task_stacks_begin;
+  if (size > (unsigned)(_task_stacks_end - boot_stack_next)) {
+    irq_restore(mie);
+    return 0;
+  }
+  lo = (unsigned *)boot_stack_next;
+  boot_stack_next += size;
+  irq_restore(mie);
+
+  for (unsigned i = 0; i < size / 4; i++)
+    lo[i] = BOOT_STACK_PAINT;
+  return lo;
+}
+
+unsigned boot_stack_free(void)
+{
+  return (unsigned)(_task_stacks_end
+                    - (boot_stack_next ? boot_stack_next : _task_stacks_begin));
+}
+
+/* Stacks grow down, so the painted words are the ones at the bottom. */
+unsigned boot_stack_used(const void *lo, unsigned size)
+{
+  const unsigned *w = lo;
+  unsigned n = 0;
+
+  while (n < size / 4 && w[n] == BOOT_STACK_PAINT)
+    n++;
+  return size - 4 * n;
+}
@@ -0,0 +1,35 @@
+#ifndef DTEKV_BOOT_H
+#define DTEKV_BOOT_H
+
+/* Memory layout, defined by dtekv-script.lds; only the addresses mean
+   anything. The stack is at the top of RAM with the stacks of the
+   dtekv-sched.c tasks and dtekv-thread.c threads below it, and the heap
+   is all of the RAM between the end of the program and those. */
+extern char __bss_start[], __bss_end[];
+extern char __heap_start[], __heap_end[];
+extern char _task_stacks_begin[], _task_stacks_end[];
+extern char _stack_begin[], _stack_end[];
+
+/* mcycle at the first instruction of _start and just before it calls
+   main (boot.S). */
+extern unsigned boot_cycle_reset;
+extern unsigned boot_cycle_main;
+
+/* Every word of a stack from boot_stack_alloc() holds this until it is
+   used; the lowest word must keep it, or the stack has overflowed. */
+#define BOOT_STACK_PAINT 0x5AA5A55Au
+
+/* Carve size bytes (a multiple of 16) from the task stack region and
+   paint them. Returns the lowest address, or 0 if the region is full. */
+void *boot_stack_alloc(unsigned size);
+
+/* Bytes of the task stack region not handed out yet. */
+unsigned boot_stack_free(void);
+
+/* Bytes of the painted stack lo .. lo + size that have ever been used. */
+unsigned boot_stack_used(const void *lo, unsigned size);
+
+/* Print the boot banner, the cycles from reset to main and the layout. */
+void boot_report(void);
+
+#endif
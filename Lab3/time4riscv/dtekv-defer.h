@@ -0,0 +1,40 @@
+#ifndef DTEKV_DEFER_H
+#define DTEKV_DEFER_H
+
+/* Work an interrupt handler hands to the main loop.
+
+     static void report(unsigned v) { print_dec(v); print("\n"); }
+     ...in an ISR:    defer(report, value);
+     ...main loop:    defer_drain();
+
+   The queue is a ring written only by defer() and read only by
+   defer_drain(). The reader takes no lock. Producers at different
+   interrupt priorities can preempt one another, so defer() masks
+   interrupts for the few instructions that claim a slot. */
+
+/* Queued items at most; a power of two. */
+#ifndef DEFER_QUEUE_SIZE
+#define DEFER_QUEUE_SIZE 32
+#endif
+
+/* arg is a value, or a pointer cast to unsigned. */
+typedef void (*defer_fn_t)(unsigned arg);
+
+struct defer_stats {
+  unsigned queued;        /* items accepted by defer() */
+  unsigned run;           /* items run by defer_drain() */
+  unsigned overflows;     /* items refused because the queue was full */
+  unsigned high_water;    /* most items ever waiting at once */
+};
+
+/* Queue fn(arg) to run in the main loop. Returns 0, or -1 if the queue
+   is full (the item is dropped and counted). */
+int defer(defer_fn_t fn, unsigned arg);
+
+/* Run every queued item, oldest first, including ones queued while it
+   runs. Returns the number run. Call from thread level only. */
+unsigned defer_drain(void);
+
+void defer_get_stats(struct defer_stats *st);
+
+#endif
@@ -0,0 +1,450 @@
+/* dtekv-fmt.c
+   Division-free integer to ASCII conversion. rv32im only has an iterative
+   divider, so quotients by constants are taken with a mulhu by the
+   reciprocal and digits are emitted two at a time from a lookup table.
+   Hex is formatted four digits per word with bit tricks on the whole word
+   and stored a word at a time. */
+
+#include "dtekv-fmt.h"
+#include "dtekv-lib.h"
+
+static const char fmt_digits2[200] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char fmt_hexdigits[16] = "0123456789ABCDEF";
+
+#define FMT_SPACES 0x20202020u
+#define FMT_DOTS   0x2E2E2E2Eu
+#define FMT_TWO    ('T' | 'W' << 8 | 'O' << 16)
+
+/* A word that may alias the chars of the buffers it is stored to. */
+typedef unsigned fmt_word __attribute__((may_alias));
+
+static const unsigned fmt_pow10[10] = {
+  1u, 10u, 100u, 1000u, 10000u,
+  100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+/* x / 100 for every 32-bit x: 0x51EB851F = ceil(2^37 / 100). */
+static inline unsigned div100(unsigned x)
+{
+  return (unsigned)(((unsigned long long)x * 0x51EB851Fu) >> 32) >> 5;
+}
+
+static unsigned fmt_ndigits(unsigned x)
+{
+  unsigned n = 1;
+  while (n < 10 && x >= fmt_pow10[n])
+    n++;
+  return n;
+}
+
+/* Write the decimal digits of x so that the last one lands at end[-1]. */
+static void fmt_put_digits(char *end, unsigned x)
+{
+  while (x >= 100) {
+    unsigned q = div100(x);
+    const char *d = &fmt_digits2[2 * (x - q * 100)];
+    end -= 2;
+    end[0] = d[0];
+    end[1] = d[1];
+    x = q;
+  }
+  if (x >= 10) {
+    end -= 2;
+    end[0] = fmt_digits2[2 * x];
+    end[1] = fmt_digits2[2 * x + 1];
+  } else {
+    end[-1] = (char)('0' + x);
+  }
+}
+
+/* Shared worker: optional sign, padding to width, then the digits. */
+static unsigned fmt_dec(char *buf, unsigned mag, int neg, unsigned width, char pad)
+{
+  unsigned n = fmt_ndigits(mag);
+  unsigned len = n + (neg ? 1 : 0);
+  char *p = buf;
+
+  if (width > len) {
+    unsigned fill = width - len;
+    if (neg && pad == '0')
+      *p++ = '-';
+    while (fill--)
+      *p++ = pad;
+    if (neg && pad != '0')
+      *p++ = '-';
+  } else if (neg) {
+    *p++ = '-';
+  }
+  fmt_put_digits(p + n, mag);
+  p[n] = '\0';
+  return (unsigned)(p + n - buf);
+}
+
+unsigned fmt_u32_width(char *buf, unsigned x, unsigned width, char pad)
+{
+  return fmt_dec(buf, x, 0, width, pad);
+}
+
+unsigned fmt_i32_width(char *buf, int x, unsigned width, char pad)
+{
+  unsigned mag = x < 0 ? 0u - (unsigned)x : (unsigned)x;
+  return fmt_dec(buf, mag, x < 0, width, pad);
+}
+
+unsigned fmt_u32(char *buf, unsigned x)
+{
+  return fmt_dec(buf, x, 0, 0, ' ');
+}
+
+unsigned fmt_i32(char *buf, int x)
+{
+  return fmt_i32_width(buf, x, 0, ' ');
+}
+
+/* Upper-case hex, always exactly digits characters (1..8), or as many as
+   needed when digits is 0. */
+unsigned fmt_hex32(char *buf, unsigned x, unsigned digits)
+{
+  if (digits == 0) {
+    digits = 1;
+    while (digits < 8 && (x >> (digits * 4)) != 0)
+      digits++;
+  } else if (digits > 8) {
+    digits = 8;
+  }
+  for (unsigned i = digits; i != 0; i--) {
+    buf[i - 1] = fmt_hexdigits[x & 0xf];
+    x >>= 4;
+  }
+  buf[digits] = '\0';
+  return digits;
+}
+
+/* The four hex digits of the low 16 bits of x in ASCII, the most
+   significant digit in the lowest byte, which is first in memory on this
+   little-endian core. The nibbles are spread to one per byte, then one add
+   finds the digits above 9 in all four bytes: n + 6 carries into bit 4 of
+   its byte exactly when n >= 10, and those bytes get the 7 that takes
+   '9' + 1 to 'A'. */
+static inline unsigned fmt_hexword(unsigned x)
+{
+  unsigned w = ((x >> 8) & 0xFFu) | ((x & 0xFFu) << 16);      /* bytes 0, 2 */
+  unsigned alpha;
+
+  w = ((w >> 4) & 0x000F000Fu) | ((w & 0x000F000Fu) << 8);   /* bytes 0..3 */
+  alpha = ((w + 0x06060606u) >> 4) & 0x01010101u;
+  return w + 0x30303030u + (alpha << 3) - alpha;
+}
+
+/* The bytes of w, with every one that is not printable ASCII replaced by
+   '.'. Bit 7 of each byte of ok says the byte is in 0x20..0x7E. */
+static inline unsigned fmt_printable(unsigned w)
+{
+  unsigned lo = w & 0x7F7F7F7Fu;
+  unsigned ok = (lo + 0x60606060u) & ~(lo + 0x01010101u) & ~w & 0x80808080u;
+  unsigned keep = (ok - (ok >> 7)) | ok;
+
+  return (w & keep) | (FMT_DOTS & ~keep);
+}
+
+/* Store the four bytes of w at p, in one store when p is aligned. */
+static inline void fmt_store(char *p, unsigned w)
+{
+  if (((unsigned)p & 3u) == 0) {
+    *(fmt_word *)p = w;
+    return;
+  }
+  p[0] = (char)w;
+  p[1] = (char)(w >> 8);
+  p[2] = (char)(w >> 16);
+  p[3] = (char)(w >> 24);
+}
+
+unsigned fmt_hex8(char *buf, unsigned x)
+{
+  fmt_store(buf, fmt_hexword(x >> 16));
+  fmt_store(buf + 4, fmt_hexword(x));
+  buf[8] = '\0';
+  return 8;
+}
+
+/* function: time2string
+   Description: Replaces the nibble-at-a-time version in timetemplate.S.
+   The first word is "MM:S"; the second is the last digit and NULs, or
+   "TWO" when that digit is a 2, picked with a mask rather than a branch. */
+void time2string(char *buf, int t)
+{
+  unsigned w = fmt_hexword((unsigned)t);
+  unsigned last = w >> 24;
+  unsigned two = 0u - (unsigned)(((unsigned)t & 0xFu) == 2);
+
+  fmt_store(buf, (w & 0xFFFFu) | (unsigned)':' << 16 | (w & 0xFF0000u) << 8);
+  fmt_store(buf + 4, last ^ ((last ^ FMT_TWO) & two));
+}
+
+/* A dump line, with every field on a word boundary:
+   "AAAAAAAA:   WWWWWWWW    WWWWWWWW    WWWWWWWW    WWWWWWWW    cccccccccccccccc\n" */
+#define FMT_DUMP_WORDS 4
+#define FMT_DUMP_LINE  (3 + 4 * FMT_DUMP_WORDS + 1)    /* in words */
+
+void fmt_hexdump(const void *addr, unsigned len)
+{
+  unsigned line[FMT_DUMP_LINE];
+  const unsigned *p = (const unsigned *)((unsigned)addr & ~3u);
+  const unsigned *end = (const unsigned *)(((unsigned)addr + len + 3u) & ~3u);
+
+  line[2] = ':' | FMT_SPACES;
+  line[FMT_DUMP_LINE - 1] = '\n';
+  for (; p < end; p += FMT_DUMP_WORDS) {
+    line[0] = fmt_hexword((unsigned)p >> 16);
+    line[1] = fmt_hexword((unsigned)p);
+    for (unsigned k = 0; k < FMT_DUMP_WORDS; k++) {
+      unsigned *f = &line[3 + 3 * k];
+
+      if (p + k < end) {
+        unsigned w = p[k];
+
+        f[0] = fmt_hexword(w >> 16);
+        f[1] = fmt_hexword(w);
+        line[3 + 3 * FMT_DUMP_WORDS + k] = fmt_printable(w);
+      } else {
+        f[0] = FMT_SPACES;
+        f[1] = FMT_SPACES;
+        line[3 + 3 * FMT_DUMP_WORDS + k] = FMT_SPACES;
+      }
+      f[2] = FMT_SPACES;
+    }
+    print((const char *)line);
+  }
+}
+
+/* function: udiv64_32
+   Description: n / d for a quotient that fits in 32 bits (n >> 32 < d),
+   by shift and subtract. rv32im has no 64-bit divide and the build does
+   not link libgcc's __udivdi3. */
+unsigned udiv64_32(unsigned long long n, unsigned d, unsigned *rem)
+{
+  unsigned hi = (unsigned)(n >> 32), lo = (unsigned)n, q = 0;
+
+  for (int i = 0; i < 32; i++) {
+    unsigned top = hi >> 31;
+    hi = (hi << 1) | (lo >> 31);
+    lo <<= 1;
+    q <<= 1;
+    if (top || hi >= d) {
+      hi -= d;
+      q |= 1;
+    }
+  }
+  if (rem)
+    *rem = hi;
+  return q;
+}
+
+void print_col(unsigned long long x, unsigned width)
+{
+  char buf[24];
+  unsigned len;
+
+  if ((x >> 32) == 0) {
+    len = fmt_u32(buf, (unsigned)x);
+  } else {
+    unsigned lo, hi = udiv64_32(x, 1000000000u, &lo);
+    len = fmt_u32(buf, hi);
+    len += fmt_u32_width(buf + len, lo, 9, '0');
+  }
+  for (; len < width; len++)
+    printc(' ');
+  print(buf);
+}
+
+void print_name(const char *s, unsigned width)
+{
+  unsigned n = 0;
+
+  for (; s[n] && n < width; n++)
+    printc(s[n]);
+  for (; n < width; n++)
+    printc(' ');
+}
+
+/* Both are shifted down until total fits in 22 bits, so the product
+   stays within 32 bits. */
+void print_share(unsigned long long x, unsigned long long total)
+{
+  unsigned pm;
+
+  while (total >> 22) {
+    x >>= 1;
+    total >>= 1;
+  }
+  pm = total ? (unsigned)x * 1000u / (unsigned)total : 0;
+  print_col(pm / 10, 4);
+  printc('.');
+  printc((char)('0' + pm % 10));
+  printc('%');
+}
+
+void print_rate(unsigned bytes, unsigned cycles, unsigned width)
+{
+  char buf[FMT_U32_LEN];
+  unsigned r = cycles ? bytes * 100 / cycles : 0;
+
+  print_col(r / 100, width - 3);
+  printc('.');
+  fmt_u32_width(buf, r % 100, 2, '0');
+  print(buf);
+}
+
+#ifdef DTEKV_BENCH
+
+/* The digit loop print_dec() used before, writing into a buffer instead
+   of the UART so that only the arithmetic is compared. */
+static unsigned ref_u32(char *buf, unsigned x)
+{
+  unsigned divident = 1000000000;
+  unsigned n = 0;
+  char first = 0;
+  do {
+    unsigned dv = x / divident;
+    if (dv != 0) first = 1;
+    if (first != 0)
+      buf[n++] = (char)('0' + dv);
+    x -= dv * divident;
+    divident /= 10;
+  } while (divident != 0);
+  if (first == 0)
+    buf[n++] = '0';
+  buf[n] = '\0';
+  return n;
+}
+
+extern void time2string_ref(char *, int);      /* timetemplate.S */
+
+#define FMT_BENCH_N    32
+#define FMT_BENCH_REPS 64
+
+static int fmt_streq(const char *a, const char *b)
+{
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+/* Check time2string() against the old one for every MM:SS pattern and
+   fmt_hex8() against fmt_hex32(), then time both pairs over in[]. */
+static void fmt_hex_bench(const unsigned *in)
+{
+  unsigned a[3], b[3];          /* word aligned, as the labs' buffers are */
+  unsigned bad = 0, t0, t_ref, t_new, h_ref, h_new;
+
+  for (unsigned t = 0; t < 0x10000u; t++) {
+    time2string_ref((char *)a, (int)t);
+    time2string((char *)b, (int)t);
+    if (!fmt_streq((char *)a, (char *)b))
+      bad++;
+  }
+  for (int i = 0; i < FMT_BENCH_N; i++) {
+    fmt_hex32((char *)a, in[i], 8);
+    fmt_hex8((char *)b, in[i]);
+    if (!fmt_streq((char *)a, (char *)b))
+      bad++;
+  }
+
+  t0 = read_mcycle();
+  for (int r = 0; r < FMT_BENCH_REPS; r++)
+    for (int i = 0; i < FMT_BENCH_N; i++)
+      time2string_ref((char *)a, (int)in[i]);
+  t_ref = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (int r = 0; r < FMT_BENCH_REPS; r++)
+    for (int i = 0; i < FMT_BENCH_N; i++)
+      time2string((char *)b, (int)in[i]);
+  t_new = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (int r = 0; r < FMT_BENCH_REPS; r++)
+    for (int i = 0; i < FMT_BENCH_N; i++)
+      fmt_hex32((char *)a, in[i], 8);
+  h_ref = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (int r = 0; r < FMT_BENCH_REPS; r++)
+    for (int i = 0; i < FMT_BENCH_N; i++)
+      fmt_hex8((char *)b, in[i]);
+  h_new = read_mcycle() - t0;
+
+  print("fmt_bench: cycles/call time2string old=");
+  print_dec(t_ref / (FMT_BENCH_N * FMT_BENCH_REPS));
+  print(" new=");
+  print_dec(t_new / (FMT_BENCH_N * FMT_BENCH_REPS));
+  print(" hex32=");
+  print_dec(h_ref / (FMT_BENCH_N * FMT_BENCH_REPS));
+  print(" hex8=");
+  print_dec(h_new / (FMT_BENCH_N * FMT_BENCH_REPS));
+  print(" mismatches=");
+  print_dec(bad);
+  print("\n");
+}
+
+/* function: fmt_bench
+   Description: Print average cycles per conversion for the old digit loop
+   and for fmt_u32() over a mix of fixed and pseudo-random inputs, then the
+   same for the old and new time2string() and for fmt_hex32()/fmt_hex8(). */
+void fmt_bench(void)
+{
+  static unsigned in[FMT_BENCH_N] = {
+    0u, 7u, 42u, 999u, 1000u, 65535u, 1234567u, 1234577u,
+    99999999u, 100000000u, 2147483647u, 4294967295u
+  };
+  char a[FMT_U32_LEN], b[FMT_U32_LEN];
+  unsigned seed = 12345u, bad = 0, t0, t_ref, t_new;
+
+  for (int i = 12; i < FMT_BENCH_N; i++) {
+    seed = seed * 1103515245u + 12345u;
+    in[i] = seed >> (i & 15);
+  }
+  for (int i = 0; i < FMT_BENCH_N; i++) {
+    ref_u32(a, in[i]);
+    fmt_u32(b, in[i]);
+    if (!fmt_streq(a, b))
+      bad++;
+  }
+
+  t0 = read_mcycle();
+  for (int r = 0; r < FMT_BENCH_REPS; r++)
+    for (int i = 0; i < FMT_BENCH_N; i++)
+      ref_u32(a, in[i]);
+  t_ref = read_mcycle() - t0;
+
+  t0 = read_mcycle();
+  for (int r = 0; r < FMT_BENCH_REPS; r++)
+    for (int i = 0; i < FMT_BENCH_N; i++)
+      fmt_u32(b, in[i]);
+  t_new = read_mcycle() - t0;
+
+  print("fmt_bench: cycles/call old=");
+  print_dec(t_ref / (FMT_BENCH_N * FMT_BENCH_REPS));
+  print(" new=");
+  print_dec(t_new / (FMT_BENCH_N * FMT_BENCH_REPS));
+  print(" mismatches=");
+  print_dec(bad);
+  print("\n");
+
+  fmt_hex_bench(in);
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef DTEKV_FMT_H
+#define DTEKV_FMT_H
+
+/* Buffer sizes (including the terminating NUL) for the unpadded variants. */
+#define FMT_U32_LEN   11    /* "4294967295" */
+#define FMT_I32_LEN   12    /* "-2147483648" */
+#define FMT_HEX32_LEN 9     /* "FFFFFFFF" */
+#define FMT_TIME_LEN  8     /* "MM:SS", or "MM:STWO" when the last digit is 2 */
+
+/* All fmt_* functions write a NUL-terminated string into buf and return the
+   number of characters written, not counting the NUL. width is a minimum
+   field width, pad is the fill character (' ' or '0'). */
+unsigned fmt_u32(char *buf, unsigned x);
+unsigned fmt_i32(char *buf, int x);
+unsigned fmt_u32_width(char *buf, unsigned x, unsigned width, char pad);
+unsigned fmt_i32_width(char *buf, int x, unsigned width, char pad);
+unsigned fmt_hex32(char *buf, unsigned x, unsigned digits);
+
+/* The word-at-a-time formatters below store whole words when buf is word
+   aligned (and fall back to bytes when it is not), so buf must have room
+   for the full words: FMT_HEX32_LEN for fmt_hex8(), FMT_TIME_LEN for
+   time2string(), even when the string is shorter. */
+unsigned fmt_hex8(char *buf, unsigned x);
+
+/* The low 16 bits of t (packed BCD MM:SS from the lab clocks) as "MM:SS". */
+void time2string(char *buf, int t);
+
+/* Print the words covering addr .. addr + len, four to a line, as hex
+   with their bytes as ASCII alongside. */
+void fmt_hexdump(const void *addr, unsigned len);
+
+/* n / d, with n % d in *rem unless rem is 0, for a quotient that fits
+   in 32 bits (n >> 32 < d). */
+unsigned udiv64_32(unsigned long long n, unsigned d, unsigned *rem);
+
+/* Report columns, printed straight to the UART: x right-aligned in width
+   characters, s cut or padded to width, x as a share of total with one
+   decimal, "  12.3%", and bytes / cycles as "b.cc" right-aligned in
+   width (bytes below 2^32 / 100). */
+void print_col(unsigned long long x, unsigned width);
+void print_name(const char *s, unsigned width);
+void print_share(unsigned long long x, unsigned long long total);
+void print_rate(unsigned bytes, unsigned cycles, unsigned width);
+
+#ifdef DTEKV_BENCH
+void fmt_bench(void);
+#endif
+
+#endif
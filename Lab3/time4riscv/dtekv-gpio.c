@@ -0,0 +1,175 @@
+/* dtekv-gpio.c
+   Switch and button inputs through the PIO edge-capture registers, with
+   a lockout debounce per pin and an event queue. Every change to the
+   driver state happens in gpio_scan(), with interrupts masked, so the
+   queue has a single producer at any time and the main loop is its only
+   consumer. */
+
+#include "dtekv-gpio.h"
+#include "dtekv-irq.h"
+#include "dtekv-lib.h"
+
+#define SW_BASE     0x04000010u
+#define BTN_BASE    0x040000D0u
+
+/* Intel PIO registers */
+#define PIO_DATA    0x0
+#define PIO_DIR     0x4
+#define PIO_IMASK   0x8
+#define PIO_ECAP    0xC
+
+#define PIO(base, reg)  (*(volatile unsigned *)((base) + (reg)))
+
+#define GQ_MASK     (GPIO_QUEUE_SIZE - 1)
+
+static unsigned gp_mask;                /* watched pins */
+static unsigned gp_level;               /* debounced levels */
+static unsigned gp_locked;              /* pins still debouncing */
+static unsigned gp_window;              /* debounce time in cycles */
+static unsigned gp_lock_start[GPIO_PINS];
+static struct gpio_stats gp_stats;
+
+static struct gpio_event gq_buf[GPIO_QUEUE_SIZE];
+static volatile unsigned gq_head;       /* written by gpio_scan() only */
+static volatile unsigned gq_tail;       /* written by the reader only */
+
+/* Raw levels of all pins. */
+static inline unsigned gpio_raw(void)
+{
+  return (PIO(SW_BASE, PIO_DATA) & GPIO_SWITCHES)
+       | (PIO(BTN_BASE, PIO_DATA) & 1u) << GPIO_BTN;
+}
+
+static void gq_push(unsigned pin, unsigned level, unsigned now)
+{
+  unsigned head = gq_head;
+  struct gpio_event *ev;
+
+  if (head - gq_tail == GPIO_QUEUE_SIZE) {
+    gp_stats.dropped++;
+    return;
+  }
+  ev = &gq_buf[head & GQ_MASK];
+  ev->time = now;
+  ev->pin = (unsigned char)pin;
+  ev->level = (unsigned char)level;
+  gq_head = head + 1;
+  gp_stats.events++;
+}
+
+/* Take the latched edges and look at every pin that has one or whose
+   debounce time may be over. A pin reports a level that differs from the
+   one it last reported, or a latched edge whose level is already gone as
+   a pulse (two events), and is then locked for gp_window cycles. Call
+   with interrupts masked. */
+static void gpio_scan(unsigned now)
+{
+  unsigned sw = PIO(SW_BASE, PIO_ECAP) & gp_mask;
+  unsigned btn = PIO(BTN_BASE, PIO_ECAP) & 1u & (gp_mask >> GPIO_BTN);
+  unsigned edges, check, raw;
+
+  if (sw)
+    PIO(SW_BASE, PIO_ECAP) = sw;
+  if (btn)
+    PIO(BTN_BASE, PIO_ECAP) = btn;
+  edges = sw | btn << GPIO_BTN;
+  check = edges | gp_locked;
+  if (check == 0)
+    return;
+
+  raw = gpio_raw();
+  for (unsigned pin = 0; check != 0; pin++, check >>= 1) {
+    unsigned bit = GPIO_BIT(pin);
+
+    if (!(check & 1u))
+      continue;
+    if (edges & bit)
+      gp_stats.edges++;
+    if (gp_locked & bit) {
+      if (now - gp_lock_start[pin] < gp_window) {
+        if (edges & bit)
+          gp_stats.bounces++;
+        continue;
+      }
+      gp_locked &= ~bit;
+    }
+    if (!((raw ^ gp_level) & bit)) {
+      if (!(edges & bit))
+        continue;
+      /* changed and changed back before it was seen: when polling, a
+         whole button press can fit between two looks */
+      gq_push(pin, ((gp_level >> pin) & 1u) ^ 1u, now);
+    } else {
+      gp_level ^= bit;
+    }
+    gp_locked |= bit;
+    gp_lock_start[pin] = now;
+    gq_push(pin, (raw >> pin) & 1u, now);
+  }
+}
+
+void gpio_isr(unsigned cause, void *ctx)
+{
+  (void)cause;
+  (void)ctx;
+  gpio_scan(read_mcycle());
+}
+
+void gpio_init(unsigned mask, unsigned debounce_ms)
+{
+  unsigned mie = irq_save();
+
+  gp_mask = mask & (GPIO_SWITCHES | GPIO_BIT(GPIO_BTN));
+  gp_window = debounce_ms * (CPU_CLK_HZ / 1000u);
+  gp_locked = 0;
+  gq_head = 0;
+  gq_tail = 0;
+
+  PIO(SW_BASE, PIO_DIR) = 0;
+  PIO(SW_BASE, PIO_ECAP) = GPIO_SWITCHES;
+  PIO(SW_BASE, PIO_IMASK) = gp_mask & GPIO_SWITCHES;
+  PIO(BTN_BASE, PIO_ECAP) = 1u;
+  PIO(BTN_BASE, PIO_IMASK) = gp_mask >> GPIO_BTN;
+  gp_level = gpio_raw() & gp_mask;
+  irq_restore(mie);
+
+  if (gp_mask & GPIO_SWITCHES)
+    irq_register(IRQ_SWITCHES, gpio_isr, 0);
+  if (gp_mask & GPIO_BIT(GPIO_BTN))
+    irq_register(IRQ_BUTTON, gpio_isr, 0);
+}
+
+int gpio_read_event(struct gpio_event *ev)
+{
+  unsigned mie = irq_save();
+  unsigned tail = gq_tail;
+  const struct gpio_event *e;
+
+  gpio_scan(read_mcycle());
+  irq_restore(mie);
+
+  if (tail == gq_head)
+    return 0;
+  e = &gq_buf[tail & GQ_MASK];
+  ev->time = e->time;
+  ev->pin = e->pin;
+  ev->level = e->level;
+  gq_tail = tail + 1;
+  return 1;
+}
+
+unsigned gpio_levels(void)
+{
+  return gp_level;
+}
+
+void gpio_get_stats(struct gpio_stats *st)
+{
+  unsigned mie = irq_save();
+
+  st->edges = gp_stats.edges;
+  st->bounces = gp_stats.bounces;
+  st->events = gp_stats.events;
+  st->dropped = gp_stats.dropped;
+  irq_restore(mie);
+}
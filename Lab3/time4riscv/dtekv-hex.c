@@ -0,0 +1,95 @@
+/* dtekv-hex.c
+   HEX display driver. hex_shown mirrors the six digit registers; a digit
+   is only written when its new pattern differs, and hex_known says which
+   mirrors are valid, so the first flush after reset writes everything. */
+
+#include "dtekv-hex.h"
+#include "dtekv-lib.h"
+
+#ifndef HEX_BASE
+#define HEX_BASE   0x04000050u
+#endif
+#ifndef HEX_STRIDE
+#define HEX_STRIDE 0x10u
+#endif
+
+#define HEX_DP_OFF 0x80u
+
+const unsigned char hex_segments[HEX_GLYPHS] = {
+  0x40, 0x79, 0x24, 0x30, 0x19, 0x12, 0x02, 0x78,   /* 0..7 */
+  0x00, 0x10, 0x08, 0x03, 0x46, 0x21, 0x06, 0x0E,   /* 8..9, A b C d E F */
+  [HEX_BLANK] = 0x7F,
+  [HEX_DASH]  = 0x3F,
+  [HEX_H]     = 0x09,
+  [HEX_L]     = 0x47,
+  [HEX_P]     = 0x0C,
+  [HEX_U]     = 0x41,
+  [HEX_n]     = 0x2B,
+  [HEX_o]     = 0x23,
+  [HEX_r]     = 0x2F,
+  [HEX_t]     = 0x07,
+  [HEX_y]     = 0x11,
+};
+
+static unsigned char hex_shown[HEX_DIGITS];
+static unsigned hex_known;
+static struct hex_stats hex_stats;
+
+void hex_frame_glyph(struct hex_frame *f, unsigned digit, unsigned glyph)
+{
+  if (digit >= HEX_DIGITS)
+    return;
+  if (glyph >= HEX_GLYPHS)
+    glyph = HEX_BLANK;
+  f->seg[digit] = hex_segments[glyph] | HEX_DP_OFF;
+  f->set |= 1u << digit;
+}
+
+void hex_frame_dp(struct hex_frame *f, unsigned digit, int on)
+{
+  if (digit >= HEX_DIGITS || !(f->set & (1u << digit)))
+    return;
+  if (on)
+    f->seg[digit] &= ~HEX_DP_OFF;
+  else
+    f->seg[digit] |= HEX_DP_OFF;
+}
+
+void hex_frame_nibbles(struct hex_frame *f, unsigned first, unsigned count,
+                       unsigned value)
+{
+  for (unsigned i = 0; i < count && first + i < HEX_DIGITS; i++) {
+    f->seg[first + i] = hex_segments[value & 0xF] | HEX_DP_OFF;
+    f->set |= 1u << (first + i);
+    value >>= 4;
+  }
+}
+
+void hex_flush(const struct hex_frame *f)
+{
+  unsigned mie = irq_save();
+
+  hex_stats.flushes++;
+  for (unsigned n = 0; n < HEX_DIGITS; n++) {
+    unsigned char seg = f->seg[n];
+
+    if (!(f->set & (1u << n)))
+      continue;
+    if ((hex_known & (1u << n)) && hex_shown[n] == seg)
+      continue;
+    *(volatile unsigned *)(HEX_BASE + n * HEX_STRIDE) = seg;
+    hex_shown[n] = seg;
+    hex_known |= 1u << n;
+    hex_stats.writes++;
+  }
+  irq_restore(mie);
+}
+
+void hex_get_stats(struct hex_stats *st)
+{
+  unsigned mie = irq_save();
+
+  st->flushes = hex_stats.flushes;
+  st->writes = hex_stats.writes;
+  irq_restore(mie);
+}
@@ -1,10 +1,73 @@
+#ifndef DTEKV_LIB_H
+#define DTEKV_LIB_H
+
+/* CPU clock of the DTEK-V board, used to turn mcycle counts into time. */
+#ifndef CPU_CLK_HZ
+#define CPU_CLK_HZ 30000000u
+#endif
+
+/* IRQ line of the JTAG UART (mcause = 0x80000000 | JTAG_UART_IRQ). */
+#ifndef JTAG_UART_IRQ
+#define JTAG_UART_IRQ 19
+#endif
+
+/* Size of the JTAG UART transmit ring, must be a power of two. */
+#ifndef UART_TX_BUF_SIZE
+#define UART_TX_BUF_SIZE 1024
+#endif
+
+/* What printc() does when the transmit ring is full. */
+enum uart_tx_policy {
+  UART_TX_BLOCK,      /* wait (polling the UART) until there is room */
+  UART_TX_DROP,       /* discard the new byte */
+  UART_TX_OVERWRITE   /* discard the oldest queued byte */
+};
+
+struct uart_tx_stats {
+  unsigned queued;       /* bytes waiting in the ring right now */
+  unsigned dropped;      /* new bytes thrown away (UART_TX_DROP) */
+  unsigned overwritten;  /* queued bytes thrown away (UART_TX_OVERWRITE) */
+};
+
+/* Disable machine interrupts and return the previous mstatus.MIE state. */
+static inline unsigned irq_save(void)
+{
+  unsigned mstatus;
+  asm volatile ("csrrci %0, mstatus, 8" : "=r"(mstatus) :: "memory");
+  return mstatus & 8;
+}
+
+/* Restore the mstatus.MIE state returned by irq_save(). */
+static inline void irq_restore(unsigned mie)
+{
+  asm volatile ("csrs mstatus, %0" :: "r"(mie) : "memory");
+}
+
+/* Low 32 bits of the cycle counter. */
+static inline unsigned read_mcycle(void)
+{
+  unsigned c;
+  asm volatile ("csrr %0, mcycle" : "=r"(c));
+  return c;
+}
+
+/* Low 32 bits of the retired-instruction counter. */
+static inline unsigned read_minstret(void)
+{
+  unsigned n;
+  asm volatile ("csrr %0, minstret" : "=r"(n));
+  return n;
+}
+
 void printc(char );
-void print(char *);
+void print(const char *);
+void uart_write(const char *buf, unsigned len);
 void print_dec(unsigned int);
 void print_hex32 ( unsigned int);
+void uart_tx_init(enum uart_tx_policy policy);
+void uart_tx_isr(unsigned cause, void *ctx);
+void uart_tx_get_stats(struct uart_tx_stats *st);
+void flush(void);
 void handle_exception ( unsigned arg0, unsigned arg1, unsigned arg2, unsigned arg3, unsigned arg4, unsigned arg5, unsigned mcause, unsigned syscall_num );
-int nextprime( int inval );
-
-
-
 
+#endif
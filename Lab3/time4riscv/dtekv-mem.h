@@ -0,0 +1,36 @@
+#ifndef DTEKV_MEM_H
+#define DTEKV_MEM_H
+
+/* memcpy, memmove, memset and memcmp, which the build does not get from
+   a C library (-nostdlib) but which gcc still calls for struct copies,
+   large initialisers and loops it recognises as one of them.
+
+     struct frame f = *saved;              gcc may call memcpy
+     memset(buf, 0, sizeof buf);
+
+   Each moves the bytes before the first word boundary of the destination
+   one at a time, then whole words: eight per iteration when source and
+   destination are equally aligned, otherwise by loading aligned source
+   words and shifting each pair together into one destination word, so no
+   access is ever misaligned. The bytes after the last whole word go one
+   at a time again; below 8 bytes everything does.
+
+   The source side may read the rest of the aligned word holding its
+   first or last byte, never a word without one of its bytes. */
+
+void *memcpy(void *dst, const void *src, unsigned n);
+
+/* Like memcpy, for buffers that may overlap. */
+void *memmove(void *dst, const void *src, unsigned n);
+
+void *memset(void *dst, int c, unsigned n);
+
+/* <0, 0 or >0 as the first differing byte of a is below, equal to or
+   above that of b, as unsigned char. */
+int memcmp(const void *a, const void *b, unsigned n);
+
+#ifdef DTEKV_BENCH
+void mem_bench(void);
+#endif
+
+#endif
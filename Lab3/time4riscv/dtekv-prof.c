@@ -0,0 +1,190 @@
+/* dtekv-prof.c
+   Region profiler: each PROF_BEGIN pushes a frame holding the mcycle and
+   minstret values at entry, PROF_END pops it and accumulates the deltas
+   into the region. The frame stack is shared with interrupt handlers, so
+   push and pop run with interrupts masked; it belongs to the running
+   thread, and prof_switch() trades it for the next one's. Counters are read as 32-bit
+   values, which limits a single region to 2^32 cycles (143 s at 30 MHz). */
+
+#include "dtekv-prof.h"
+
+#ifdef DTEKV_PROF
+
+#include "dtekv-lib.h"
+#include "dtekv-fmt.h"
+
+static struct prof_stack cur;  /* of the running thread */
+static struct prof_region *regions, **regions_tail = &regions;
+static unsigned prof_errors;  /* unbalanced or too deeply nested BEGIN/END */
+
+struct trap_stats trap_stats;
+
+void prof_begin(struct prof_region *r)
+{
+  unsigned mie = irq_save();
+
+  if (cur.depth < PROF_MAX_DEPTH) {
+    struct prof_frame *f = &cur.frame[cur.depth];
+    f->r = r;
+    f->child = 0;
+    f->i0 = read_minstret();
+    f->c0 = read_mcycle();
+  } else {
+    prof_errors++;
+  }
+  cur.depth++;
+  irq_restore(mie);
+}
+
+void prof_end(struct prof_region *r)
+{
+  unsigned c1 = read_mcycle();
+  unsigned i1 = read_minstret();
+  unsigned mie = irq_save();
+  struct prof_frame *f;
+  unsigned dc;
+
+  if (cur.depth == 0) {
+    prof_errors++;
+    irq_restore(mie);
+    return;
+  }
+  if (--cur.depth >= PROF_MAX_DEPTH) {
+    irq_restore(mie);
+    return;
+  }
+  f = &cur.frame[cur.depth];
+  if (f->r != r) {
+    prof_errors++;
+    irq_restore(mie);
+    return;
+  }
+
+  dc = c1 - f->c0;
+  if (!r->listed) {
+    r->listed = 1;
+    *regions_tail = r;
+    regions_tail = &r->next;
+  }
+  r->count++;
+  if (dc < r->min)
+    r->min = dc;
+  if (dc > r->max)
+    r->max = dc;
+  r->total += dc;
+  r->self += dc - f->child;
+  r->insns += i1 - f->i0;
+  if (cur.depth > 0 && cur.depth <= PROF_MAX_DEPTH)
+    cur.frame[cur.depth - 1].child += dc;
+  irq_restore(mie);
+}
+
+/* function: prof_switch
+   Description: called by thread_schedule() with interrupts masked when
+   one thread gives the CPU to another. The open regions of the thread
+   leaving go to out; those of the one coming back are taken from in and
+   moved forward by the cycles and instructions since it left, so that a
+   region counts only the time its own thread ran. */
+void prof_switch(struct prof_stack *out, struct prof_stack *in)
+{
+  unsigned c = read_mcycle(), i = read_minstret();
+  unsigned dc = c - in->c_out, di = i - in->i_out;
+
+  for (unsigned k = 0; k < cur.depth && k < PROF_MAX_DEPTH; k++)
+    out->frame[k] = cur.frame[k];
+  out->depth = cur.depth;
+  out->c_out = c;
+  out->i_out = i;
+  for (unsigned k = 0; k < in->depth && k < PROF_MAX_DEPTH; k++) {
+    cur.frame[k] = in->frame[k];
+    cur.frame[k].c0 += dc;
+    cur.frame[k].i0 += di;
+  }
+  cur.depth = in->depth;
+}
+
+void prof_reset(void)
+{
+  unsigned mie = irq_save();
+
+  for (struct prof_region *r = regions; r; r = r->next) {
+    r->count = 0;
+    r->min = 0xffffffffu;
+    r->max = 0;
+    r->total = r->self = r->insns = 0;
+  }
+  prof_errors = 0;
+  trap_stats.count = trap_stats.entry_total = trap_stats.entry_max = 0;
+  trap_stats.exit_total = trap_stats.exit_max = 0;
+  irq_restore(mie);
+}
+
+/* Cycles for an empty PROF_BEGIN/PROF_END pair; the reported min, mean
+   and max of every region include this once. */
+static unsigned prof_overhead(void)
+{
+  static struct prof_region cal = { "", 0, 0xffffffffu, 0, 0, 0, 0, 0, 1 };
+
+  for (int i = 0; i < 8; i++) {
+    prof_begin(&cal);
+    prof_end(&cal);
+  }
+  return cal.min;
+}
+
+/* function: prof_dump
+   Description: print one line per region that has completed at least
+   once, in the order they were first seen: count, min/mean/max cycles,
+   total and self cycles, and cycles per instruction (x100). */
+void prof_dump(void)
+{
+  print("\nregion             count       min      mean       max"
+        "          total           self  CPIx100\n");
+  for (struct prof_region *r = regions; r; r = r->next) {
+    unsigned mie = irq_save();
+    unsigned count = r->count, min = r->min, max = r->max;
+    unsigned long long total = r->total, self = r->self, insns = r->insns;
+    irq_restore(mie);
+
+    if (count == 0)
+      continue;
+    print_name(r->name, 16);
+    print_col(count, 8);
+    print_col(min, 10);
+    print_col(udiv64_32(total, count, 0), 10);
+    print_col(max, 10);
+    print_col(total, 15);
+    print_col(self, 15);
+    /* keep the divisor in 32 bits and the quotient small */
+    while ((insns >> 32) != 0 || (total >> 50) != 0) {
+      insns >>= 1;
+      total >>= 1;
+    }
+    print_col(insns ? udiv64_32(total * 100, (unsigned)insns, 0) : 0, 9);
+    printc('\n');
+  }
+  if (trap_stats.count) {
+    unsigned n = trap_stats.count;
+    print("interrupts: ");
+    print_dec(n);
+    print(", entry mean/max ");
+    print_dec(trap_stats.entry_total / n);
+    printc('/');
+    print_dec(trap_stats.entry_max);
+    print(", exit mean/max ");
+    print_dec(trap_stats.exit_total / n);
+    printc('/');
+    print_dec(trap_stats.exit_max);
+    print(" cycles\n");
+  }
+  print("overhead per region: ");
+  print_dec(prof_overhead());
+  print(" cycles");
+  if (prof_errors) {
+    print(", unbalanced/too deep: ");
+    print_dec(prof_errors);
+  }
+  printc('\n');
+}
+
+#endif
@@ -0,0 +1,262 @@
+/* dtekv-sched.c
+   Cooperative EDF scheduler. The ready queue is a list sorted by
+   deadline and the sleep queue one sorted by wake time; both are short,
+   so a sorted insert is cheaper than anything cleverer. The running task
+   is on neither. Only thread level touches the queues, so nothing here
+   masks interrupts; the one interrupt involved is the one-shot timer
+   that ends an idle wfi, and its callback does nothing.
+
+   A sleeper's new deadline counts from its wake time rather than from
+   when the scheduler noticed it, so a periodic task that sleeps until
+   t += period keeps the same deadlines however late it is picked up. */
+
+#include "dtekv-sched.h"
+#include "dtekv-lib.h"
+#include "dtekv-fmt.h"
+#include "dtekv-boot.h"
+
+/* dtekv-switch.S */
+extern void task_switch(unsigned *save_sp, unsigned new_sp);
+extern void task_trampoline(void);
+
+static struct task *sc_ready;        /* by deadline, earliest first */
+static struct task *sc_sleep;        /* by wake time, earliest first */
+static struct task *sc_all;          /* every task, newest first */
+static struct task *sc_cur;
+static unsigned sc_boot_sp;          /* main's context while tasks run */
+static unsigned sc_run_start;        /* mcycle when sc_cur was switched to */
+static unsigned sc_yield_start;      /* mcycle at yield(), 0 if none pending */
+static struct sched_stats sc_stats;
+static struct soft_timer sc_wake_timer;
+
+/* Insert t behind every task with a key not above its own. */
+static void sc_insert(struct task **q, struct task *t)
+{
+  while (*q && (*q)->key <= t->key)
+    q = &(*q)->next;
+  t->next = *q;
+  *q = t;
+}
+
+/* Move every sleeper due by now to the ready queue. */
+static void sc_wake(unsigned long long now)
+{
+  while (sc_sleep && sc_sleep->key <= now) {
+    struct task *t = sc_sleep;
+
+    sc_sleep = t->next;
+    t->state = TASK_READY;
+    t->key += t->rel_deadline;
+    sc_insert(&sc_ready, t);
+  }
+}
+
+static void sc_wake_cb(struct soft_timer *t, void *arg)
+{
+  (void)t;
+  (void)arg;
+}
+
+/* Nothing is ready: wait for the earliest sleeper. wfi runs with MIE
+   clear, as in dl_sleep(), so the wake-up cannot slip in between the
+   test and the wfi. Returns the time at which a task became ready. */
+static unsigned long long sc_idle(void)
+{
+  unsigned t0 = read_mcycle();
+  unsigned long long now;
+
+  for (;;) {
+    unsigned mie;
+
+    now = timer_now();
+    sc_wake(now);
+    if (sc_ready)
+      break;
+    mie = irq_save();
+    timer_start(&sc_wake_timer, sc_sleep->key, sc_wake_cb, 0);
+    asm volatile ("wfi");
+    irq_restore(mie);
+  }
+  sc_stats.idle += read_mcycle() - t0;
+  return now;
+}
+
+static void sc_overflow(struct task *t)
+{
+  print("\n[SCHED] Stack overflow in task ");
+  print(t->name);
+  printc('\n');
+  flush();
+  while (1);
+}
+
+/* Charge the running task, which has already been queued or finished,
+   and switch to the ready task with the earliest deadline. With no task
+   left at all, go back to sched_start(). */
+static void sc_schedule(void)
+{
+  struct task *prev = sc_cur, *next;
+  unsigned long long now;
+  unsigned run;
+
+  if (prev) {
+    if (prev->stack_lo[0] != BOOT_STACK_PAINT)
+      sc_overflow(prev);
+    run = read_mcycle() - sc_run_start;
+    prev->cycles += run;
+    if (run > prev->run_max)
+      prev->run_max = run;
+  }
+
+  now = timer_now();
+  sc_wake(now);
+  if (!sc_ready) {
+    if (!sc_sleep) {
+      sc_cur = 0;
+      task_switch(&prev->sp, sc_boot_sp);
+    }
+    now = sc_idle();
+  }
+
+  next = sc_ready;
+  sc_ready = next->next;
+  if (now > next->key && now - next->key > next->late_max)
+    next->late_max = (unsigned)(now - next->key);
+  next->runs++;
+  sc_cur = next;
+  if (next != prev) {
+    sc_stats.switches++;
+    sc_run_start = read_mcycle();
+    task_switch(prev ? &prev->sp : &sc_boot_sp, next->sp);
+    /* back in prev, switched to by some later sc_schedule() */
+  } else {
+    sc_yield_start = 0;
+    sc_run_start = read_mcycle();
+  }
+  if (sc_yield_start) {
+    unsigned c = read_mcycle() - sc_yield_start;
+
+    if (c < sc_stats.switch_min)
+      sc_stats.switch_min = c;
+    sc_yield_start = 0;
+  }
+}
+
+/* First switch to a task lands in task_trampoline, which has not come
+   through sc_schedule(); its yield cost is not counted. */
+int task_create(struct task *t, const char *name, task_fn_t fn, unsigned arg,
+                unsigned stack_size, unsigned rel_deadline)
+{
+  unsigned *sp;
+
+  stack_size = (stack_size + 15) & ~15u;
+  if (stack_size < TASK_STACK_MIN)
+    return -1;
+  t->stack_lo = boot_stack_alloc(stack_size);
+  if (!t->stack_lo)
+    return -1;
+  t->stack_size = stack_size;
+  if (!sc_all)
+    sc_stats.switch_min = ~0u;
+
+  /* what task_switch() pops on the first switch to t */
+  sp = (unsigned *)((char *)t->stack_lo + stack_size - TASK_CTX_SIZE);
+  for (unsigned i = 0; i < TASK_CTX_SIZE / 4; i++)
+    sp[i] = 0;
+  sp[TASK_CTX_RA / 4] = (unsigned)task_trampoline;
+  sp[TASK_CTX_S0 / 4] = (unsigned)fn;
+  sp[TASK_CTX_S1 / 4] = arg;
+
+  t->sp = (unsigned)sp;
+  t->name = name;
+  t->state = TASK_READY;
+  t->rel_deadline = rel_deadline;
+  t->cycles = 0;
+  t->runs = 0;
+  t->run_max = 0;
+  t->late_max = 0;
+  t->key = (timer_active() ? timer_now() : 0) + rel_deadline;
+  sc_insert(&sc_ready, t);
+  t->all = sc_all;
+  sc_all = t;
+  return 0;
+}
+
+void sched_start(void)
+{
+  if (sc_ready || sc_sleep)
+    sc_schedule();
+}
+
+void yield(void)
+{
+  struct task *t = sc_cur;
+
+  sc_yield_start = read_mcycle();
+  t->key = timer_now() + t->rel_deadline;
+  sc_insert(&sc_ready, t);
+  sc_schedule();
+}
+
+void sleep_until(unsigned long long wake)
+{
+  struct task *t = sc_cur;
+
+  if (wake <= timer_now()) {
+    yield();
+    return;
+  }
+  t->state = TASK_SLEEPING;
+  t->key = wake;
+  sc_insert(&sc_sleep, t);
+  sc_schedule();
+}
+
+struct task *task_current(void)
+{
+  return sc_cur;
+}
+
+void task_exit(void)
+{
+  sc_cur->state = TASK_DONE;
+  sc_schedule();
+}
+
+void sched_get_stats(struct sched_stats *st)
+{
+  *st = sc_stats;
+  st->stack_free = boot_stack_free();
+}
+
+/* function: sched_report
+   Description: per task how often it ran, its share of all cycles since
+   the first task was created, its longest run in cycles (how long it
+   kept everyone else waiting), how late it started at worst in us, and
+   its stack use; then the idle share and the cheapest yield. */
+void sched_report(void)
+{
+  unsigned long long total = sc_stats.idle;
+
+  for (struct task *t = sc_all; t; t = t->all)
+    total += t->cycles;
+  print("\ntask           runs     cpu   run_max  late_us   stack\n");
+  for (struct task *t = sc_all; t; t = t->all) {
+    print_name(t->name, 10);
+    print_col(t->runs, 9);
+    print_share(t->cycles, total);
+    print_col(t->run_max, 10);
+    print_col(t->late_max / (TIMER_CLK_HZ / 1000000u), 9);
+    print_col(boot_stack_used(t->stack_lo, t->stack_size), 7);
+    printc('/');
+    print_dec(t->stack_size);
+    print(t->state == TASK_DONE ? " done\n" : "\n");
+  }
+  print("idle               ");
+  print_share(sc_stats.idle, total);
+  print("\nswitches ");
+  print_dec(sc_stats.switches);
+  print(", yield to another task ");
+  print_dec(sc_stats.switch_min == ~0u ? 0 : sc_stats.switch_min);
+  print(" cycles at best\n");
+}
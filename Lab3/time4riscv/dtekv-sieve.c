@@ -0,0 +1,122 @@
+/* dtekv-sieve.c
+   Incremental segmented sieve of Eratosthenes. Only odd numbers are kept,
+   one bit each, in a segment of SIEVE_SEG_WORDS words. When the segment is
+   used up the next one is sieved with the base primes, whose next multiple
+   is carried over from the previous segment so no division is needed. */
+
+#include "dtekv-sieve.h"
+#include "dtekv-prime.h"
+
+#define SEG_BITS (SIEVE_SEG_WORDS * 32)
+
+static unsigned seg[SIEVE_SEG_WORDS];   /* bit j set: seg_lo + 2j is composite */
+static unsigned seg_lo;                  /* first (odd) number in the segment */
+static unsigned seg_pos;                 /* next bit to scan */
+
+static unsigned short base_p[SIEVE_BASE_MAX];    /* odd primes 3, 5, 7, ... */
+static unsigned short base_off[SIEVE_BASE_MAX];  /* next multiple, as bit index */
+static unsigned base_n;
+static unsigned base_cand;               /* next odd number to test for base_p */
+
+static unsigned ps_last;                 /* last prime handed out */
+static int ps_two;                       /* 2 still has to be returned */
+static int ps_fallback;                  /* out of base primes, use nextprime() */
+
+/* Count trailing zeros of a non-zero word with a de Bruijn multiply;
+   rv32im has no ctz instruction. */
+static unsigned ctz32(unsigned x)
+{
+  static const unsigned char debruijn[32] = {
+     0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8,
+    31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9
+  };
+  return debruijn[((x & (0u - x)) * 0x077CB531u) >> 27];
+}
+
+/* Make sure every odd prime p with p*p < hi is a base prime. Returns 0 if
+   that would need more than SIEVE_BASE_MAX of them. */
+static int base_extend(unsigned hi)
+{
+  while (base_cand * base_cand < hi) {
+    unsigned q = base_cand;
+    int prime = 1;
+
+    for (unsigned i = 0; i < base_n && base_p[i] * base_p[i] <= q; i++)
+      if (q % base_p[i] == 0) {
+        prime = 0;
+        break;
+      }
+    if (prime) {
+      unsigned m = q * q;
+      if (base_n == SIEVE_BASE_MAX)
+        return 0;
+      if (m < seg_lo) {
+        /* only on the first segment: first odd multiple >= seg_lo */
+        unsigned r = seg_lo % q;
+        m = r ? seg_lo + q - r : seg_lo;
+        if ((m & 1) == 0)
+          m += q;
+      }
+      base_p[base_n] = (unsigned short)q;
+      base_off[base_n] = (unsigned short)((m - seg_lo) >> 1);
+      base_n++;
+    }
+    base_cand += 2;
+  }
+  return 1;
+}
+
+/* Sieve the segment starting at seg_lo. */
+static int seg_fill(void)
+{
+  if (!base_extend(seg_lo + 2 * SEG_BITS))
+    return 0;
+  for (unsigned w = 0; w < SIEVE_SEG_WORDS; w++)
+    seg[w] = 0;
+  for (unsigned i = 0; i < base_n; i++) {
+    unsigned p = base_p[i];
+    unsigned j = base_off[i];
+    for (; j < SEG_BITS; j += p)
+      seg[j >> 5] |= 1u << (j & 31);
+    base_off[i] = (unsigned short)(j - SEG_BITS);
+  }
+  seg_pos = 0;
+  return 1;
+}
+
+void prime_stream_init(int start)
+{
+  unsigned s = start < 2 ? 2u : (unsigned)start;
+
+  ps_two = start < 2;
+  ps_last = s;
+  ps_fallback = 0;
+  base_n = 0;
+  base_cand = 3;
+  seg_lo = (s + 1) | 1;
+  ps_fallback = !seg_fill();
+}
+
+int prime_stream_next(void)
+{
+  if (ps_two) {
+    ps_two = 0;
+    return 2;
+  }
+  while (!ps_fallback) {
+    while (seg_pos < SEG_BITS) {
+      unsigned bits = ~seg[seg_pos >> 5] >> (seg_pos & 31);
+      if (bits != 0) {
+        seg_pos += ctz32(bits);
+        ps_last = seg_lo + 2 * seg_pos;
+        seg_pos++;
+        return (int)ps_last;
+      }
+      seg_pos = (seg_pos | 31) + 1;
+    }
+    seg_lo += 2 * SEG_BITS;
+    ps_fallback = !seg_fill();
+  }
+  ps_last = (unsigned)nextprime((int)ps_last);
+  return (int)ps_last;
+}
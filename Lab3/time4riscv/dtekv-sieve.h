@@ -0,0 +1,20 @@
+#ifndef DTEKV_SIEVE_H
+#define DTEKV_SIEVE_H
+
+/* Words of sieve per segment; each word covers 32 odd numbers. */
+#ifndef SIEVE_SEG_WORDS
+#define SIEVE_SEG_WORDS 32
+#endif
+
+/* Number of base primes kept for sieving. 1024 odd primes reach 8171, so
+   the sieve covers everything below 8171^2 (about 6.6e7); past that the
+   stream falls back to nextprime(). */
+#ifndef SIEVE_BASE_MAX
+#define SIEVE_BASE_MAX 1024
+#endif
+
+/* Primes in increasing order, starting with the first one above start. */
+void prime_stream_init(int start);
+int prime_stream_next(void);
+
+#endif
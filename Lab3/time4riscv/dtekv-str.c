@@ -0,0 +1,159 @@
+/* dtekv-str.c
+   STR_BYTE(w, i) is the i-th byte in memory of a loaded word w, so
+   str_widen() keeps the string's order on either byte order; the zero
+   test needs no such care, the NUL is found again by bytes.
+
+   As in dtekv-mem.c, STR_NOLIBCALL keeps gcc from turning the byte
+   loops here into calls to strlen. */
+
+#include "dtekv-str.h"
+
+#ifdef DTEKV_BENCH
+#include "dtekv-lib.h"
+#include "dtekv-fmt.h"
+#endif
+
+#define STR_NOLIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define STR_BYTE(w, i)  ((w) >> (24 - 8 * (i)) & 0xffu)
+#else
+#define STR_BYTE(w, i)  ((w) >> (8 * (i)) & 0xffu)
+#endif
+
+/* A word that may alias the chars of the string. */
+typedef unsigned str_word __attribute__((__may_alias__));
+
+STR_NOLIBCALL unsigned strlen(const char *s)
+{
+  const char *p = s;
+  const str_word *w;
+
+  for (; (unsigned)p & 3; p++)
+    if (!*p)
+      return (unsigned)(p - s);
+  w = (const str_word *)p;
+  while (!str_haszero(*w))
+    w++;
+  for (p = (const char *)w; *p; p++)
+    ;
+  return (unsigned)(p - s);
+}
+
+STR_NOLIBCALL unsigned str_widen(unsigned *dst, const char *src)
+{
+  unsigned n = 0;
+  const str_word *w;
+
+  for (; (unsigned)src & 3; src++, n++) {
+    if (!*src)
+      return n;
+    dst[n] = (unsigned char)*src;
+  }
+  for (w = (const str_word *)src; ; w++, n += 4) {
+    unsigned x = *w;
+
+    if (str_haszero(x))
+      break;
+    dst[n] = STR_BYTE(x, 0);
+    dst[n + 1] = STR_BYTE(x, 1);
+    dst[n + 2] = STR_BYTE(x, 2);
+    dst[n + 3] = STR_BYTE(x, 3);
+  }
+  for (src = (const char *)w; *src; src++)
+    dst[n++] = (unsigned char)*src;
+  return n;
+}
+
+#ifdef DTEKV_BENCH
+#define STR_BENCH_MAX 4096
+
+static char str_bench_buf[STR_BENCH_MAX + 8] __attribute__((aligned(4)));
+static unsigned str_bench_codes[STR_BENCH_MAX];
+
+static STR_NOLIBCALL unsigned str_len_bytes(const char *s)
+{
+  const char *p = s;
+
+  while (*p)
+    p++;
+  return (unsigned)(p - s);
+}
+
+static STR_NOLIBCALL unsigned str_widen_bytes(unsigned *dst, const char *src)
+{
+  unsigned n = 0;
+
+  for (; *src; src++)
+    dst[n++] = (unsigned char)*src;
+  return n;
+}
+
+/* Fill str_bench_buf + off with a string of len letters. */
+static char *sb_string(unsigned off, unsigned len)
+{
+  char *s = str_bench_buf + off;
+
+  for (unsigned i = 0; i < len; i++)
+    s[i] = (char)('a' + i % 26);
+  s[len] = '\0';
+  return s;
+}
+
+/* function: str_bench
+   Description: Bytes per cycle of strlen() and str_widen() against
+   their byte loops, on strings of 16 to 4096 characters, the slowest of
+   the four start offsets from a word boundary. Ends with a check of
+   both against the byte loops at every length up to 64 and offset. */
+void str_bench(void)
+{
+  static unsigned ref[64];
+  volatile unsigned sink = 0;
+  unsigned bad = 0;
+
+  print("str_bench: bytes/cycle\n     len  strlen   bytes   widen   bytes\n");
+  for (unsigned len = 16; len <= STR_BENCH_MAX; len *= 4) {
+    unsigned reps = STR_BENCH_MAX / len, worst[4] = { 0, 0, 0, 0 };
+
+    for (unsigned off = 0; off < 4; off++) {
+      char *s = sb_string(off, len);
+      unsigned t[5];
+
+      t[0] = read_mcycle();
+      for (unsigned r = 0; r < reps; r++)
+        sink += strlen(s);
+      t[1] = read_mcycle();
+      for (unsigned r = 0; r < reps; r++)
+        sink += str_len_bytes(s);
+      t[2] = read_mcycle();
+      for (unsigned r = 0; r < reps; r++)
+        sink += str_widen(str_bench_codes, s);
+      t[3] = read_mcycle();
+      for (unsigned r = 0; r < reps; r++)
+        sink += str_widen_bytes(str_bench_codes, s);
+      t[4] = read_mcycle();
+      for (unsigned k = 0; k < 4; k++)
+        if (t[k + 1] - t[k] > worst[k])
+          worst[k] = t[k + 1] - t[k];
+    }
+    print_col(len, 8);
+    for (unsigned k = 0; k < 4; k++)
+      print_rate(len * reps, worst[k], 8);
+    printc('\n');
+  }
+
+  for (unsigned off = 0; off < 4; off++)
+    for (unsigned len = 0; len < 64; len++) {
+      char *s = sb_string(off, len);
+
+      s[len + 1] = 'x';               /* a non-NUL after the NUL */
+      if (strlen(s) != len || str_widen(str_bench_codes, s) != len
+          || str_widen_bytes(ref, s) != len)
+        bad++;
+      for (unsigned i = 0; i < len; i++)
+        if (str_bench_codes[i] != ref[i])
+          bad++;
+    }
+  print(bad ? "str_bench: check FAILED\n" : "str_bench: check ok\n");
+}
+#endif
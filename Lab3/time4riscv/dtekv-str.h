@@ -0,0 +1,84 @@
+#ifndef DTEKV_STR_H
+#define DTEKV_STR_H
+
+/* String kernels that look at a word at a time, and loads and stores of
+   words at any address in a stated byte order.
+
+     n = strlen(s);
+     n = str_widen(codes, "abc");          codes[] = { 'a', 'b', 'c' }
+     w = load_le32(buf + 3);               no misaligned lw, no cast
+
+   A string is read a byte at a time up to its first word boundary and
+   then a whole word per iteration, until str_haszero() finds its NUL.
+   An aligned word that holds some byte of the string never crosses into
+   memory the string does not reach, so reading the rest of the word
+   after the NUL is safe.
+
+   The load and store helpers go byte by byte, so they work at any
+   alignment and give the same value whatever the byte order of the
+   core, unlike reading a word through a cast char pointer. */
+
+#define STR_ONES   0x01010101u
+#define STR_HIGHS  0x80808080u
+
+/* Nonzero if some byte of w is 0. Exact for the lowest zero byte;
+   bytes above it may be flagged too (a 0x01 above a 0 is). */
+static inline unsigned str_haszero(unsigned w)
+{
+  return (w - STR_ONES) & ~w & STR_HIGHS;
+}
+
+/* Bytes before the terminating NUL. */
+unsigned strlen(const char *s);
+
+/* Store each character of src in a word of dst, zero-extended, four per
+   loaded word, and return how many; the NUL is not stored. */
+unsigned str_widen(unsigned *dst, const char *src);
+
+static inline unsigned load_le16(const void *p)
+{
+  const unsigned char *b = p;
+  return b[0] | (unsigned)b[1] << 8;
+}
+
+static inline unsigned load_le32(const void *p)
+{
+  const unsigned char *b = p;
+  return b[0] | (unsigned)b[1] << 8 | (unsigned)b[2] << 16 | (unsigned)b[3] << 24;
+}
+
+static inline unsigned load_be16(const void *p)
+{
+  const unsigned char *b = p;
+  return (unsigned)b[0] << 8 | b[1];
+}
+
+static inline unsigned load_be32(const void *p)
+{
+  const unsigned char *b = p;
+  return (unsigned)b[0] << 24 | (unsigned)b[1] << 16 | (unsigned)b[2] << 8 | b[3];
+}
+
+static inline void store_le32(void *p, unsigned x)
+{
+  unsigned char *b = p;
+  b[0] = (unsigned char)x;
+  b[1] = (unsigned char)(x >> 8);
+  b[2] = (unsigned char)(x >> 16);
+  b[3] = (unsigned char)(x >> 24);
+}
+
+static inline void store_be32(void *p, unsigned x)
+{
+  unsigned char *b = p;
+  b[0] = (unsigned char)(x >> 24);
+  b[1] = (unsigned char)(x >> 16);
+  b[2] = (unsigned char)(x >> 8);
+  b[3] = (unsigned char)x;
+}
+
+#ifdef DTEKV_BENCH
+void str_bench(void);
+#endif
+
+#endif
@@ -0,0 +1,484 @@
+/* dtekv-thread.c
+   Preemptive priority scheduler. Every priority has a FIFO run queue and
+   th_ready has bit p set while queue p is not empty; the running thread
+   is on none of them. boot.S calls thread_schedule() with the saved sp
+   of the thread it suspends, and resumes the one whose sp it returns.
+
+   A thread leaves the CPU in one of two ways: at the end of an interrupt
+   taken at thread level while thread_resched is set (a preemption), or
+   through thread_switch() when it blocks, yields or ends. Either way its
+   registers sit in a trap frame on its stack, so a thread preempted at
+   any instruction and one that called thread_switch() are resumed the
+   same way. */
+
+#include "dtekv-thread.h"
+#include "dtekv-lib.h"
+#include "dtekv-fmt.h"
+#include "dtekv-boot.h"
+#include "dtekv-timer.h"
+
+/* boot.S */
+extern void thread_switch(void);
+extern unsigned thread_frame(unsigned top, thread_fn_t fn, unsigned arg);
+unsigned thread_schedule(unsigned sp);
+
+volatile unsigned thread_resched;
+
+static struct thread *th_head[THREAD_PRIOS], *th_tail[THREAD_PRIOS];
+static unsigned th_ready;            /* bit p: th_head[p] is not empty */
+static struct thread *th_cur;
+static struct thread *th_all;        /* every thread, newest first */
+static struct thread th_main, th_idle;
+static unsigned th_run_start;        /* mcycle when th_cur was switched to */
+static int th_voluntary;             /* the switch under way is not a preemption */
+static struct soft_timer th_slice_timer;
+static struct thread_stats th_stats;
+
+static void th_enqueue(struct thread *t)
+{
+  unsigned p = t->prio;
+
+  t->next = 0;
+  if (th_head[p])
+    th_tail[p]->next = t;
+  else
+    th_head[p] = t;
+  th_tail[p] = t;
+  th_ready |= 1u << p;
+}
+
+static struct thread *th_dequeue(unsigned p)
+{
+  struct thread *t = th_head[p];
+
+  th_head[p] = t->next;
+  if (!th_head[p])
+    th_ready &= ~(1u << p);
+  return t;
+}
+
+/* Highest priority with a ready thread, or -1. */
+static int th_top(void)
+{
+  for (int p = THREAD_PRIOS - 1; p >= 0; p--)
+    if (th_ready & (1u << p))
+      return p;
+  return -1;
+}
+
+static void th_overflow(struct thread *t)
+{
+  print("\n[THREAD] Stack overflow in thread ");
+  print(t->name);
+  printc('\n');
+  flush();
+  while (1);
+}
+
+/* function: thread_schedule
+   Description: called by boot.S with interrupts masked and the stack
+   pointer of the thread it has just suspended. Charges that thread,
+   queues it again at the tail of its run queue if it is still ready,
+   and returns the saved sp of the first thread of the highest ready
+   priority, or of the idle thread. */
+unsigned thread_schedule(unsigned sp)
+{
+  struct thread *prev = th_cur, *next;
+  int p;
+
+  prev->sp = sp;
+  prev->cycles += read_mcycle() - th_run_start;
+  if (prev->stack_lo[0] != BOOT_STACK_PAINT)
+    th_overflow(prev);
+  thread_resched = 0;
+  if (prev->state == THREAD_READY && prev != &th_idle)
+    th_enqueue(prev);
+
+  p = th_top();
+  next = p < 0 ? &th_idle : th_dequeue((unsigned)p);
+  if (next != prev) {
+    th_stats.switches++;
+    if (!th_voluntary) {
+      th_stats.preemptions++;
+      if (prev != &th_idle)
+        prev->preempted++;
+    }
+    next->runs++;
+#ifdef DTEKV_PROF
+    prof_switch(&prev->prof, &next->prof);
+#endif
+  }
+  th_voluntary = 0;
+  th_cur = next;
+  th_run_start = read_mcycle();
+  return next->sp;
+}
+
+/* Suspend the caller with interrupts masked and run the next thread. */
+static void th_switch(void)
+{
+  th_voluntary = 1;
+  thread_switch();
+}
+
+/* Make t ready; interrupts masked. Nonzero if it outranks the running
+   thread, which should then give way. */
+static int th_wake(struct thread *t)
+{
+  t->state = THREAD_READY;
+  th_enqueue(t);
+  return th_cur == &th_idle || t->prio > th_cur->prio;
+}
+
+/* Block the caller on wait list q, behind the waiters of its priority
+   and above; interrupts masked. Returns once it has been woken. */
+static void th_block(struct thread **q)
+{
+  struct thread *t = th_cur;
+
+  while (*q && (*q)->prio >= t->prio)
+    q = &(*q)->next;
+  t->next = *q;
+  *q = t;
+  t->state = THREAD_BLOCKED;
+  th_switch();
+}
+
+/* The time slice: another thread of the running one's priority is
+   waiting, so the running one goes to the back of the queue. */
+static void th_slice(struct soft_timer *timer, void *arg)
+{
+  int p = th_top();
+
+  (void)timer;
+  (void)arg;
+  if (p >= 0 && (th_cur == &th_idle || (unsigned)p >= th_cur->prio)) {
+    thread_resched = 1;
+    th_stats.slices++;
+  }
+}
+
+static void th_idle_fn(unsigned arg)
+{
+  (void)arg;
+  for (;;)
+    asm volatile ("wfi");
+}
+
+static int th_setup(struct thread *t, const char *name, thread_fn_t fn,
+                    unsigned arg, unsigned stack_size, unsigned prio)
+{
+  unsigned mie;
+
+  stack_size = (stack_size + 15) & ~15u;
+  if (stack_size < THREAD_STACK_MIN)
+    return -1;
+  t->stack_lo = boot_stack_alloc(stack_size);
+  if (!t->stack_lo)
+    return -1;
+  t->stack_size = stack_size;
+  t->sp = thread_frame((unsigned)t->stack_lo + stack_size, fn, arg);
+  t->name = name;
+  t->prio = (unsigned char)prio;
+  t->state = THREAD_READY;
+  t->cycles = 0;
+  t->runs = 0;
+  t->preempted = 0;
+#ifdef DTEKV_PROF
+  t->prof.depth = 0;
+#endif
+
+  mie = irq_save();
+  t->all = th_all;
+  th_all = t;
+  irq_restore(mie);
+  return 0;
+}
+
+/* The boot stack below the caller's frame is painted here, so that
+   thread_report() can tell how much of it main has used. */
+void thread_init(unsigned slice_us, unsigned main_prio)
+{
+  unsigned *w = (unsigned *)_stack_begin;
+  unsigned *in_use = (unsigned *)__builtin_frame_address(0) - 64;
+
+  while (w < in_use)
+    *w++ = BOOT_STACK_PAINT;
+  th_main.stack_lo = (unsigned *)_stack_begin;
+  th_main.stack_size = (unsigned)(_stack_end - _stack_begin);
+  th_main.name = "main";
+  th_main.prio = (unsigned char)(main_prio < THREAD_PRIOS ? main_prio : 0);
+  th_main.state = THREAD_READY;
+  th_main.runs = 1;
+  th_main.all = th_all;
+  th_all = &th_main;
+  th_cur = &th_main;
+  th_run_start = read_mcycle();
+
+  th_setup(&th_idle, "idle", th_idle_fn, 0, THREAD_STACK_MIN, 0);
+
+  if (slice_us) {
+    unsigned slice = (unsigned)TIMER_US(slice_us);
+
+    th_stats.slice = slice;
+    timer_start_periodic(&th_slice_timer, timer_now() + slice, slice,
+                         th_slice, 0);
+  }
+}
+
+int thread_create(struct thread *t, const char *name, thread_fn_t fn,
+                  unsigned arg, unsigned stack_size, unsigned prio)
+{
+  unsigned mie;
+
+  if (prio >= THREAD_PRIOS || th_setup(t, name, fn, arg, stack_size, prio))
+    return -1;
+  mie = irq_save();
+  if (th_wake(t))
+    th_switch();
+  irq_restore(mie);
+  return 0;
+}
+
+void thread_yield(void)
+{
+  unsigned mie = irq_save();
+
+  if (th_top() >= (int)th_cur->prio)
+    th_switch();
+  irq_restore(mie);
+}
+
+void thread_exit(void)
+{
+  irq_save();
+  th_cur->state = THREAD_DONE;
+  th_switch();
+}
+
+struct thread *thread_self(void)
+{
+  return th_cur;
+}
+
+void sem_init(struct sem *s, int count)
+{
+  s->count = count;
+  s->waiters = 0;
+}
+
+void sem_wait(struct sem *s)
+{
+  unsigned mie = irq_save();
+
+  if (s->count > 0)
+    s->count--;
+  else
+    th_block(&s->waiters);      /* sem_post() handed its unit over */
+  irq_restore(mie);
+}
+
+int sem_trywait(struct sem *s)
+{
+  unsigned mie = irq_save();
+  int taken = s->count > 0;
+
+  if (taken)
+    s->count--;
+  irq_restore(mie);
+  return taken;
+}
+
+/* Interrupts masked. Nonzero if the woken waiter outranks the running
+   thread. */
+static int th_post(struct sem *s)
+{
+  struct thread *t = s->waiters;
+
+  if (!t) {
+    s->count++;
+    return 0;
+  }
+  s->waiters = t->next;
+  return th_wake(t);
+}
+
+void sem_post(struct sem *s)
+{
+  unsigned mie = irq_save();
+
+  if (th_post(s))
+    th_switch();
+  irq_restore(mie);
+}
+
+void sem_post_isr(struct sem *s)
+{
+  unsigned mie = irq_save();
+
+  if (th_post(s))
+    thread_resched = 1;
+  irq_restore(mie);
+}
+
+void mutex_init(struct mutex *m)
+{
+  m->owner = 0;
+  m->waiters = 0;
+}
+
+void mutex_lock(struct mutex *m)
+{
+  unsigned mie = irq_save();
+
+  if (!m->owner)
+    m->owner = th_cur;
+  else
+    th_block(&m->waiters);      /* mutex_unlock() made us the owner */
+  irq_restore(mie);
+}
+
+/* function: mutex_unlock
+   Description: Hand m to its first waiter, or leave it free. Unlocking a
+   mutex the caller does not hold would let two threads in at once, so
+   it halts with a message instead, as a stack overflow does. */
+void mutex_unlock(struct mutex *m)
+{
+  unsigned mie = irq_save();
+  struct thread *t = m->waiters;
+
+  if (m->owner != th_cur) {
+    print("\n[THREAD] mutex_unlock by ");
+    print(th_cur->name);
+    print(m->owner ? ", which does not own the mutex\n" : " of a mutex that is not locked\n");
+    flush();
+    while (1);
+  }
+  m->owner = t;
+  if (t) {
+    m->waiters = t->next;
+    if (th_wake(t))
+      th_switch();
+  }
+  irq_restore(mie);
+}
+
+void thread_get_stats(struct thread_stats *st)
+{
+  unsigned mie = irq_save();
+
+  *st = th_stats;
+  irq_restore(mie);
+}
+
+/* function: thread_report
+   Description: per thread its priority, how often it was switched to and
+   how often the CPU was taken from it, its share of the cycles since
+   thread_init() and its stack use; then the switch counts. The running
+   thread's current run is not counted yet. */
+void thread_report(void)
+{
+  unsigned long long total = 0;
+  struct thread_stats st;
+
+  thread_get_stats(&st);
+  for (struct thread *t = th_all; t; t = t->all)
+    total += t->cycles;
+  print("\nthread    prio      runs preempted     cpu     stack\n");
+  for (struct thread *t = th_all; t; t = t->all) {
+    print_name(t->name, 10);
+    print_col(t->prio, 4);
+    print_col(t->runs, 10);
+    print_col(t->preempted, 10);
+    print_share(t->cycles, total);
+    print_col(boot_stack_used(t->stack_lo, t->stack_size), 10);
+    printc('/');
+    print_dec(t->stack_size);
+    print(t->state == THREAD_DONE ? " done\n" : "\n");
+  }
+  print("switches ");
+  print_dec(st.switches);
+  print(", preemptions ");
+  print_dec(st.preemptions);
+  print(", time slices ");
+  print_dec(st.slices);
+  print(" of ");
+  print_dec(st.slice / (TIMER_CLK_HZ / 1000000u));
+  print(" us\n");
+}
+
+#ifdef DTEKV_BENCH
+#define TH_BENCH_N 1000
+
+static struct sem th_bench_done, th_bench_ping, th_bench_pong;
+static struct thread th_bench_t[4];
+static unsigned th_bench_used;
+
+static void th_bench_yield(unsigned arg)
+{
+  (void)arg;
+  for (int i = 0; i < TH_BENCH_N; i++)
+    thread_yield();
+  sem_post(&th_bench_done);
+}
+
+static void th_bench_ping_fn(unsigned arg)
+{
+  (void)arg;
+  for (int i = 0; i < TH_BENCH_N; i++) {
+    sem_post(&th_bench_ping);
+    sem_wait(&th_bench_pong);
+  }
+  sem_post(&th_bench_done);
+}
+
+static void th_bench_pong_fn(unsigned arg)
+{
+  (void)arg;
+  for (int i = 0; i < TH_BENCH_N; i++) {
+    sem_wait(&th_bench_ping);
+    sem_post(&th_bench_pong);
+  }
+  sem_post(&th_bench_done);
+}
+
+/* Run fa and fb as two threads of the caller's priority, wait until
+   both have posted th_bench_done and return the cycles since. */
+static unsigned th_bench_pair(thread_fn_t fa, thread_fn_t fb)
+{
+  unsigned prio = th_cur->prio, t0 = read_mcycle();
+  struct thread *t = &th_bench_t[th_bench_used];
+
+  th_bench_used += 2;
+  if (thread_create(&t[0], "bench a", fa, 0, 2048, prio)
+      || thread_create(&t[1], "bench b", fb, 0, 2048, prio))
+    return 0;
+  sem_wait(&th_bench_done);
+  sem_wait(&th_bench_done);
+  return read_mcycle() - t0;
+}
+
+/* function: thread_bench
+   Description: cycles per switch when two threads of one priority yield
+   to each other TH_BENCH_N times each, and per hand-off when they pass
+   a semaphore back and forth TH_BENCH_N times (two switches a round).
+   Each includes the whole trap frame, thread_schedule() and the mret.
+   Call from a thread that has no other thread of its priority yet; the
+   four bench stacks stay allocated. */
+void thread_bench(void)
+{
+  unsigned c_yield, c_sem;
+
+  sem_init(&th_bench_done, 0);
+  sem_init(&th_bench_ping, 0);
+  sem_init(&th_bench_pong, 0);
+  c_yield = th_bench_pair(th_bench_yield, th_bench_yield);
+  c_sem = th_bench_pair(th_bench_ping_fn, th_bench_pong_fn);
+
+  print("thread_bench: cycles per yield switch=");
+  print_dec(c_yield / (2 * TH_BENCH_N));
+  print(" per semaphore hand-off=");
+  print_dec(c_sem / (2 * TH_BENCH_N));
+  print("\n");
+}
+#endif
@@ -0,0 +1,98 @@
+#ifndef DTEKV_TIMER_H
+#define DTEKV_TIMER_H
+
+/* Software timers on the interval timer.
+
+     static struct soft_timer t;
+     timer_init(TIMER_TICKLESS, 0);
+     timer_start_periodic(&t, timer_now() + TIMER_MS(1000),
+                          TIMER_MS(1000), cb, 0);
+
+   Time is a 64-bit count of timer cycles since timer_init(), read from
+   the hardware counter through its snapshot registers, so it has the
+   resolution of the timer clock and not of the interrupt rate. */
+
+/* Clock of the interval timer and unit of every time below. */
+#ifndef TIMER_CLK_HZ
+#define TIMER_CLK_HZ 30000000u
+#endif
+
+#define TIMER_US(n)  ((unsigned long long)(n) * (TIMER_CLK_HZ / 1000000u))
+#define TIMER_MS(n)  ((unsigned long long)(n) * (TIMER_CLK_HZ / 1000u))
+
+/* Pending timers sit in a hierarchical wheel of TIMER_WHEEL_LEVELS levels
+   of 32 slots. A level-0 slot spans 2^TIMER_WHEEL_SHIFT cycles (34 us),
+   which is the granularity of a deadline: callbacks run at most that
+   much plus the interrupt latency late, never early. The wheel reaches
+   2^(TIMER_WHEEL_SHIFT + 5 * TIMER_WHEEL_LEVELS) cycles (19 minutes)
+   ahead; later deadlines are parked at its far end and put back in. */
+#ifndef TIMER_WHEEL_SHIFT
+#define TIMER_WHEEL_SHIFT 10
+#endif
+#define TIMER_WHEEL_LEVELS 5
+
+enum timer_mode {
+  TIMER_TICKLESS,   /* one interrupt per deadline, reprogrammed each time */
+  TIMER_PERIODIC    /* fixed tick rate; the wheel advances on every tick */
+};
+
+struct soft_timer;
+
+/* Callbacks run in the timer interrupt, at IRQ_TIMER's priority. */
+typedef void (*timer_cb_t)(struct soft_timer *t, void *arg);
+
+struct soft_timer {
+  unsigned long long deadline;        /* timer_now() value to fire at */
+  unsigned period;                    /* cycles, 0 for a one-shot timer */
+  timer_cb_t cb;
+  void *arg;
+  struct soft_timer *next, **pprev;   /* wheel slot; pprev is 0 when idle */
+  unsigned slot;
+};
+
+struct timer_stats {
+  unsigned irqs;         /* timer interrupts taken */
+  unsigned reprograms;   /* one-shot periods written (tickless) */
+  unsigned fired;        /* callbacks run */
+  unsigned late_max;     /* cycles from a deadline to its callback */
+};
+
+/* Program the interval timer and register its interrupt. In
+   TIMER_PERIODIC mode it interrupts tick_hz times a second; tick_hz is
+   ignored in TIMER_TICKLESS mode. Call once, before enable_interrupt(). */
+void timer_init(enum timer_mode mode, unsigned tick_hz);
+
+/* Nonzero once timer_init() has run. */
+int timer_active(void);
+
+/* Timer cycles since timer_init(). */
+unsigned long long timer_now(void);
+
+/* Run cb(t, arg) once at deadline; a deadline in the past fires on the
+   next interrupt. t must stay valid until it has fired or been stopped.
+   Starting a pending timer moves it. */
+void timer_start(struct soft_timer *t, unsigned long long deadline,
+                 timer_cb_t cb, void *arg);
+
+/* Run cb(t, arg) at first and then every period cycles. Deadlines are
+   kept on the grid first + n * period, so a late callback does not
+   shift the ones after it. */
+void timer_start_periodic(struct soft_timer *t, unsigned long long first,
+                          unsigned period, timer_cb_t cb, void *arg);
+
+/* Cancel t; harmless if it is not pending. May be called from its own
+   callback to end a periodic timer. */
+void timer_stop(struct soft_timer *t);
+
+static inline int timer_pending(const struct soft_timer *t)
+{
+  return t->pprev != 0;
+}
+
+void timer_get_stats(struct timer_stats *st);
+
+#ifdef DTEKV_BENCH
+void timer_bench(void);
+#endif
+
+#endif
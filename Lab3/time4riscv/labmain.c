@@ -5,13 +5,19 @@
 /* External functions from other files */
 extern void print(const char*);
 extern void print_dec(unsigned int);
-extern void display_string(int, char*);
+extern void display_string(char*);
 extern void time2string(char*, int);
 extern void tick(int*);
 extern void delay(int);
 extern int nextprime(int);
 
 #include <stdint.h>
+#include "dtekv-prof.h"
+#include "dtekv-hex.h"
+#include "dtekv-delay.h"
+#include "dtekv-bcd.h"
+#include "dtekv-boot.h"
+#include "dtekv-gpio.h"
 
 /* --------------------------------------------------
    HEX display memory-mapped base and stride
@@ -23,23 +29,12 @@ extern int nextprime(int);
 /* --------------------------------------------------
    Globals
 -------------------------------------------------- */
-int mytime = 0x5957; /*just a starting value for a text clock (used by time2string/tick).*/
+int mytime = 0x5957; /* HH:MM:SS, packed BCD (text clock for time2string) */
 int led_val = 0;
 char textstring[] = "text, more text, and even more text!";
 
-/* Active-low 7-seg patterns for digits 0..9 (DP is bit7) */
-const int LED_NBR[] = {
-    64,   /* 0 */
-    121,  /* 1 */
-    36,   /* 2 */
-    48,   /* 3 */
-    25,   /* 4 */
-    18,   /* 5 */
-    2,    /* 6 */
-    120,  /* 7 */
-    0,    /* 8 */
-    16    /* 9 */
-};
+PROF_REGION(p_time2string, "time2string");
+PROF_REGION(p_tick, "tick");
 
 /* --------------------------------------------------
    Assignment 1 I/O functions
@@ -55,16 +50,12 @@ control LEDs others stay 0*/
 /* (e) Write one hex digit to one 7-seg display (HEX0..HEX5).
    DP is OFF by default (active-low -> bit7=1). */
 void set_displays(int display_number, int value) {
-    if (display_number < 0 || display_number > 5) return; /* HEX0..HEX5 */
+    struct hex_frame f;
 
-    volatile unsigned int *disp =
-        (volatile unsigned int *)(HEX_BASE + (unsigned)display_number * HEX_STRIDE);
-/*Computes the address of HEX*/
-    unsigned int patt = ((unsigned int)LED_NBR[value & 0xF]) & 0xFFu;
-    /*Looks up the active-low pattern for the decimal digit value & 0xF (0..9).*/
-    patt |= 0x80u; /* ensure decimal point is OFF */
-
-    *disp = patt;
+    hex_frame_init(&f);   /* goes through the HEX framebuffer: a digit
+                             that already shows value is not rewritten */
+    hex_frame_glyph(&f, (unsigned)display_number, (unsigned)value & 0xFu);
+    hex_flush(&f);        /* HEX0..HEX5 only, DP off */
 }
 /*Writes the 8-bit pattern to that display.*/
 
@@ -89,24 +80,24 @@ void labinit(void) {}
 
 /* Helper: show HH:MM:SS across HEX5..HEX0
    HEX5 HEX4   HEX3 HEX2   HEX1 HEX0
-     H   H       M   M       S   S   (HEX0 is rightmost) */
-static void show_time(int hours, int minutes, int seconds) {
-    /* seconds */
-    set_displays(0, seconds % 10);
-    set_displays(1, (seconds / 10) % 10);
-    /* minutes */
-    set_displays(2, minutes % 10);
-    set_displays(3, (minutes / 10) % 10);
-    /* hours */
-    set_displays(4, hours % 10);
-    set_displays(5, (hours / 10) % 10);
+     H   H       M   M       S   S   (HEX0 is rightmost)
+   The clock is packed BCD (0x00HHMMSS): each nibble is one digit. */
+static void show_time(unsigned hhmmss) {
+    struct hex_frame f;
+
+    hex_frame_init(&f);
+    hex_frame_nibbles(&f, 0, 6, hhmmss);
+    hex_flush(&f);   /* one update; usually only HEX0 changes */
 }
 
 /* --------------------------------------------------
    Main program – Assignment 1 (d & h)
 -------------------------------------------------- */
 int main(void) {
+    boot_report();                     /* banner, boot cycles, memory map */
     labinit();
+    delay_init();              /* times delays on the interval timer */
+    delay_report();
 
     /* ---- (d) Start sequence on LEDs ----
        Increment the value shown on the first 4 LEDs once per "second"
@@ -114,38 +105,47 @@ int main(void) {
     set_leds(0);               /* start at 0 */
     for (int n = 0; n < 16; ++n) {
         set_leds(n);           /* show n on the lowest 4 LEDs */
-        delay(600);            /* ~1s coarse delay; tune if needed */
+        delay_ms(1000);        /* 1 s, measured on the timer */
     }
 
     /* ---- (h) Clock loop with button/switch updates ---- */
-    int sec = 0, min = 0, hr = 0;
+    unsigned clock = 0;        /* HH:MM:SS, packed BCD */
+
+    gpio_init(GPIO_SWITCHES | GPIO_BIT(GPIO_BTN), 20);  /* polled */
 
     while (1) {
-        delay(600); /* ~1 second */
+        delay_ms(1000); /* 1 second */
 
         /* Update terminal string (optional) */
+        PROF_BEGIN(p_time2string);
         time2string(textstring, mytime);
-        display_string(3, textstring);
-        tick(&mytime);
-
-        /* Update software clock */
-        if (++sec >= 60) {
-            sec = 0;
-            if (++min >= 60) {
-                min = 0;
-                if (++hr >= 100) hr = 0; /* 2-digit hour wrap */
-            }
-        }
+        PROF_END(p_time2string);
+        display_string(textstring);
+        PROF_BEGIN(p_tick);
+        mytime = (int)bcd_clock_inc((unsigned)mytime, &bcd_clock_100h);
+        PROF_END(p_tick);
+
+        /* Update software clock (wraps after 99:59:59) */
+        clock = bcd_clock_inc(clock, &bcd_clock_100h);
+        if ((clock & 0xFFu) == 0)
+            PROF_DUMP();                /* profile table once a minute */
 
         /* Show HH:MM:SS on HEX5..HEX0 */
-        show_time(hr, min, sec);
+        show_time(clock);
+
+        /* Button presses since the last pass: the clock keeps running
+           while the button is held, and bounces are filtered out */
+        struct gpio_event ev;
+        int quit = 0;
 
-        /* If button pressed, read switches and update fields */
-        if (get_btn()) {
-            int sw = get_sw();
+        while (gpio_read_event(&ev)) {
+            if (ev.pin != GPIO_BTN || !ev.level)
+                continue;
+            int sw = (int)(gpio_levels() & GPIO_SWITCHES);
 
             /* Use SW7 (bit6) as "exit" */
             if ((sw >> 6) & 1) {
+                quit = 1;
                 break;
             }
 
@@ -154,17 +154,16 @@ int main(void) {
             int val = sw & 0x3F; /* 6-bit new value */
 
             if (sel == 1) {           /* 01 -> seconds */
-                sec = val % 60;
+                clock = (clock & ~0xFFu) | bin2bcd((unsigned)val % 60);
             } else if (sel == 2) {    /* 10 -> minutes */
-                min = val % 60;
+                clock = (clock & ~0xFF00u) | bin2bcd((unsigned)val % 60) << 8;
             } else if (sel == 3) {    /* 11 -> hours */
-                hr = val % 100;
+                clock = (clock & ~0xFF0000u) | bin2bcd((unsigned)val % 100) << 16;
             }
-            show_time(hr, min, sec);
-
-            /* crude debounce: wait for release */
-            while (get_btn()) { /* spin */ }
+            show_time(clock);
         }
+        if (quit)
+            break;
     }
 
     return 0;
@@ -0,0 +1,86 @@
+/* dtekv-defer.c
+   Deferred work: a ring of (fn, arg) items. dq_head and dq_tail run
+   freely and are masked on access; the head moves only in defer() and
+   the tail only in defer_drain(), each after its slot is written or read,
+   so the reader never sees a half-written item. */
+
+#include "dtekv-defer.h"
+#include "dtekv-lib.h"
+
+#define DQ_MASK (DEFER_QUEUE_SIZE - 1)
+
+/* Keeps the compiler from moving the item accesses across the index
+   update; the core itself does not reorder. */
+#define dq_barrier() asm volatile ("" ::: "memory")
+
+struct defer_item {
+  defer_fn_t fn;
+  unsigned arg;
+};
+
+static struct defer_item dq_buf[DEFER_QUEUE_SIZE];
+static volatile unsigned dq_head;
+static volatile unsigned dq_tail;
+static struct defer_stats dq_stats;
+
+int defer(defer_fn_t fn, unsigned arg)
+{
+  unsigned mie = irq_save();
+  unsigned head = dq_head;
+  unsigned used = head - dq_tail;
+  struct defer_item *it;
+
+  if (used == DEFER_QUEUE_SIZE) {
+    dq_stats.overflows++;
+    irq_restore(mie);
+    return -1;
+  }
+  it = &dq_buf[head & DQ_MASK];
+  it->fn = fn;
+  it->arg = arg;
+  dq_barrier();
+  dq_head = head + 1;
+  dq_stats.queued++;
+  if (used + 1 > dq_stats.high_water)
+    dq_stats.high_water = used + 1;
+  irq_restore(mie);
+  return 0;
+}
+
+unsigned defer_drain(void)
+{
+  unsigned tail = dq_tail;
+  unsigned n = 0;
+
+  while (tail != dq_head) {
+    const struct defer_item *it;
+    defer_fn_t fn;
+    unsigned arg;
+
+    dq_barrier();
+    it = &dq_buf[tail & DQ_MASK];
+    fn = it->fn;
+    arg = it->arg;
+    dq_barrier();
+    dq_tail = ++tail;           /* free the slot before running the item */
+    fn(arg);
+    n++;
+  }
+  if (n != 0) {
+    unsigned mie = irq_save();
+    dq_stats.run += n;
+    irq_restore(mie);
+  }
+  return n;
+}
+
+void defer_get_stats(struct defer_stats *st)
+{
+  unsigned mie = irq_save();
+
+  st->queued = dq_stats.queued;
+  st->run = dq_stats.run;
+  st->overflows = dq_stats.overflows;
+  st->high_water = dq_stats.high_water;
+  irq_restore(mie);
+}
@@ -0,0 +1,171 @@
+/* dtekv-irq.c
+   Per-cause interrupt dispatch. boot.S installs a vectored mtvec: every
+   interrupt enters _irq_routine, which indexes irq_table with the cause
+   and calls the handler found there, so no cause is ever tested in a
+   chain and adding a device only means one irq_register() call.
+
+   Handlers run at their cause's priority level with MIE set again, so a
+   higher-priority cause preempts them; mie masks the rest. boot.S keeps
+   the interrupted mepc, mstatus and level in the trap frame. */
+
+#include "dtekv-irq.h"
+#include "dtekv-lib.h"
+
+/* Causes nobody registered keep going to the lab's handle_interrupt(). */
+static void irq_default(unsigned cause, void *ctx)
+{
+  (void)ctx;
+  handle_interrupt(cause);
+}
+
+struct irq_entry irq_table[IRQ_TABLE_SIZE] = {
+  [0 ... IRQ_TABLE_SIZE - 1] = { irq_default, 0 }
+};
+
+unsigned char irq_prio[IRQ_TABLE_SIZE] = {
+  [0 ... IRQ_TABLE_SIZE - 1] = IRQ_PRIO_DEFAULT
+};
+unsigned irq_level;
+unsigned irq_enabled;
+unsigned irq_above[IRQ_PRIO_MAX + 1] = { 0xffffffffu };
+
+/* Bring mie in line with irq_enabled and the current level.
+   Must be called with interrupts disabled. */
+static void irq_update_mie(void)
+{
+  unsigned mie = irq_enabled & irq_above[irq_level];
+  asm volatile ("csrw mie, %0" :: "r"(mie));
+}
+
+int irq_register(unsigned cause, irq_handler_t fn, void *ctx)
+{
+  unsigned mie;
+
+  if (cause < 2 || cause >= IRQ_TABLE_SIZE || fn == 0)
+    return -1;
+  mie = irq_save();
+  irq_table[cause].fn = fn;
+  irq_table[cause].ctx = ctx;
+  irq_enabled |= 1u << cause;
+  irq_update_mie();
+  irq_restore(mie);
+  return 0;
+}
+
+void irq_unregister(unsigned cause)
+{
+  unsigned mie;
+
+  if (cause < 2 || cause >= IRQ_TABLE_SIZE)
+    return;
+  mie = irq_save();
+  irq_enabled &= ~(1u << cause);
+  irq_update_mie();
+  irq_table[cause].fn = irq_default;
+  irq_table[cause].ctx = 0;
+  irq_restore(mie);
+}
+
+int irq_set_priority(unsigned cause, unsigned prio)
+{
+  unsigned mie;
+
+  if (cause >= IRQ_TABLE_SIZE || prio < 1 || prio > IRQ_PRIO_MAX)
+    return -1;
+  mie = irq_save();
+  irq_prio[cause] = (unsigned char)prio;
+  for (unsigned level = 0; level <= IRQ_PRIO_MAX; level++) {
+    if (prio > level)
+      irq_above[level] |= 1u << cause;
+    else
+      irq_above[level] &= ~(1u << cause);
+  }
+  irq_update_mie();
+  irq_restore(mie);
+  return 0;
+}
+
+#ifdef DTEKV_BENCH
+/* Latency of a high-priority interrupt that arrives while a long
+   low-priority handler runs. The timer handler (low) raises the JTAG UART
+   write interrupt (high) as it starts and then keeps the CPU for
+   BENCH_BUSY cycles; the UART handler measures how long it had to wait.
+   Must run before uart_tx_init() and labinit() take the two devices. */
+#define BENCH_TIMER     ((volatile unsigned int*) 0x04000020)
+#define BENCH_UART_CTRL ((volatile unsigned int*) 0x04000044)
+#define BENCH_PERIOD    89999u      /* 3 ms at 30 MHz */
+#define BENCH_BUSY      30000u      /* 1 ms */
+#define BENCH_SAMPLES   50
+
+static volatile unsigned bench_t0, bench_n, bench_max, bench_total;
+
+static void bench_low(unsigned cause, void *ctx)
+{
+  unsigned start;
+
+  (void)cause;
+  (void)ctx;
+  BENCH_TIMER[0] = 0;                   /* ack the timeout */
+  start = read_mcycle();
+  bench_t0 = start;
+  *BENCH_UART_CTRL = 2;                 /* WE: raise the high-priority IRQ */
+  while (read_mcycle() - start < BENCH_BUSY)
+    ;
+}
+
+static void bench_high(unsigned cause, void *ctx)
+{
+  unsigned lat = read_mcycle() - bench_t0;
+
+  (void)cause;
+  (void)ctx;
+  *BENCH_UART_CTRL = 0;
+  if (bench_n < BENCH_SAMPLES) {
+    bench_n++;
+    bench_total += lat;
+    if (lat > bench_max)
+      bench_max = lat;
+  }
+}
+
+static void bench_run(const char *label, unsigned high_prio)
+{
+  unsigned mie = irq_save();
+
+  bench_n = bench_max = bench_total = 0;
+  irq_set_priority(IRQ_TIMER, 1);
+  irq_set_priority(JTAG_UART_IRQ, high_prio);
+  irq_register(IRQ_TIMER, bench_low, 0);
+  irq_register(JTAG_UART_IRQ, bench_high, 0);
+  BENCH_TIMER[1] = 8;                   /* STOP */
+  BENCH_TIMER[0] = 0;
+  BENCH_TIMER[2] = BENCH_PERIOD & 0xffff;
+  BENCH_TIMER[3] = BENCH_PERIOD >> 16;
+  BENCH_TIMER[1] = 7;                   /* ITO | CONT | START */
+  irq_restore(8);
+  while (bench_n < BENCH_SAMPLES)
+    ;
+  irq_save();
+  BENCH_TIMER[1] = 8;
+  BENCH_TIMER[0] = 0;
+  *BENCH_UART_CTRL = 0;
+  irq_unregister(IRQ_TIMER);
+  irq_unregister(JTAG_UART_IRQ);
+  irq_set_priority(IRQ_TIMER, IRQ_PRIO_DEFAULT);
+  irq_set_priority(JTAG_UART_IRQ, IRQ_PRIO_DEFAULT);
+  irq_restore(mie);
+
+  print(label);
+  print(": high-priority latency mean ");
+  print_dec(bench_total / BENCH_SAMPLES);
+  print(", max ");
+  print_dec(bench_max);
+  print(" cycles\n");
+}
+
+void irq_latency_bench(void)
+{
+  bench_run("irq, same priority (no nesting)", 1);
+  bench_run("irq, higher priority (nesting)  ", 3);
+}
+#endif
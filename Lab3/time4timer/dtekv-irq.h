@@ -0,0 +1,61 @@
+#ifndef DTEKV_IRQ_H
+#define DTEKV_IRQ_H
+
+/* Interrupt causes that get their own slot in the vector table and in
+   irq_table; a power of two. Also used by boot.S. */
+#define IRQ_TABLE_SIZE 32
+
+/* Interrupt causes of the DTEK-V devices (JTAG_UART_IRQ in dtekv-lib.h). */
+#define IRQ_TIMER     16
+#define IRQ_SWITCHES  17
+#define IRQ_BUTTON    18
+
+/* Interrupt priorities run from 1 (lowest, the default for every cause)
+   to IRQ_PRIO_MAX. While a handler runs, only causes with a strictly
+   higher priority can interrupt it; level 0 is thread level. Build with
+   -DDTEKV_NO_IRQ_NESTING to run every handler with interrupts masked. */
+#define IRQ_PRIO_MAX      7
+#define IRQ_PRIO_DEFAULT  1
+
+#ifndef __ASSEMBLER__
+
+/* An interrupt handler gets its cause and the ctx it was registered with. */
+typedef void (*irq_handler_t)(unsigned cause, void *ctx);
+
+/* One dispatch slot; boot.S loads fn from offset 0 and ctx from 4. */
+struct irq_entry {
+  irq_handler_t fn;
+  void *ctx;
+};
+
+extern struct irq_entry irq_table[IRQ_TABLE_SIZE];
+
+/* Used by boot.S: priority per cause, the current level, the set of
+   registered causes, and for each level the causes above it. mie is
+   always irq_enabled & irq_above[irq_level]. */
+extern unsigned char irq_prio[IRQ_TABLE_SIZE];
+extern unsigned irq_level;
+extern unsigned irq_enabled;
+extern unsigned irq_above[IRQ_PRIO_MAX + 1];
+
+/* Install fn for cause and enable the cause in mie. Returns 0, or -1 if
+   cause has no slot (0 and 1 are the exception and reset vectors). */
+int irq_register(unsigned cause, irq_handler_t fn, void *ctx);
+
+/* Disable cause in mie and route it back to handle_interrupt(). */
+void irq_unregister(unsigned cause);
+
+/* Set the priority of cause, 1..IRQ_PRIO_MAX. Returns 0, or -1 if cause
+   or prio is out of range. */
+int irq_set_priority(unsigned cause, unsigned prio);
+
+#ifdef DTEKV_BENCH
+void irq_latency_bench(void);
+#endif
+
+/* Catch-all for causes without a registered handler, defined by each lab. */
+void handle_interrupt(unsigned cause);
+
+#endif
+
+#endif
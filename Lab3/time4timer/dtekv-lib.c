@@ -1,54 +1,197 @@
 #include "dtekv-lib.h"
+#include "dtekv-fmt.h"
+#include "dtekv-irq.h"
+#include "dtekv-str.h"
 
 #define JTAG_UART ((volatile unsigned int*) 0x04000040)
 #define JTAG_CTRL ((volatile unsigned int*) 0x04000044)
 
+#define JTAG_CTRL_WE  (1u << 1)   /* interrupt when the write FIFO has space */
+#define TX_MASK       (UART_TX_BUF_SIZE - 1)
+
+/* Transmit ring. printc() queues bytes at tx_head, the UART is fed from
+   tx_tail, both indices run freely and are masked on access. Until
+   uart_tx_init() is called printc() writes straight to the UART as before. */
+static volatile char tx_buf[UART_TX_BUF_SIZE];
+static volatile unsigned tx_head;
+static volatile unsigned tx_tail;
+static enum uart_tx_policy tx_policy;
+static unsigned tx_irq_on;
+static unsigned tx_dropped;
+static unsigned tx_overwritten;
+
+/* Move queued bytes into the hardware FIFO while it has room.
+   Must be called with interrupts disabled. */
+static void tx_drain(void)
+{
+  unsigned space = (*JTAG_CTRL) >> 16;
+  unsigned tail = tx_tail;
+
+  while (space != 0 && tail != tx_head) {
+    *JTAG_UART = tx_buf[tail & TX_MASK];
+    tail++;
+    space--;
+  }
+  tx_tail = tail;
+}
+
+/* Queue one byte, applying the overflow policy if the ring is full.
+   Must be called with interrupts disabled. */
+static void tx_put(char c)
+{
+  if (tx_head - tx_tail == UART_TX_BUF_SIZE) {
+    switch (tx_policy) {
+    case UART_TX_DROP:
+      tx_dropped++;
+      return;
+    case UART_TX_OVERWRITE:
+      tx_tail++;
+      tx_overwritten++;
+      break;
+    default:
+      while (tx_head - tx_tail == UART_TX_BUF_SIZE)
+        tx_drain();
+      break;
+    }
+  }
+  tx_buf[tx_head & TX_MASK] = c;
+  tx_head++;
+}
+
+/* Push what fits into the FIFO now and let the write-space interrupt
+   take care of the rest. Must be called with interrupts disabled. */
+static void tx_kick(void)
+{
+  tx_drain();
+  if (tx_head != tx_tail)
+    *JTAG_CTRL = JTAG_CTRL_WE;
+}
+
 void printc(char s)
 {
+  if (!tx_irq_on) {
     while (((*JTAG_CTRL)&0xffff0000) == 0);
     *JTAG_UART = s;
+    return;
+  }
+  unsigned irq = irq_save();
+  tx_put(s);
+  tx_kick();
+  irq_restore(irq);
 }
 
-void print(char *s)
-{  
-  while (*s != '\0') {    
-      printc(*s);
-      s++;
+/* function: print
+   Description: Finds the end of s a word at a time with strlen(), then
+   queues the bytes as uart_write() does. */
+void print(const char *s)
+{
+  uart_write(s, strlen(s));
+}
+
+/* function: uart_write
+   Description: Queue len bytes from buf, NULs included, with one kick
+   at the end. Interrupts are masked per byte, so a long buffer does not
+   hold them off while the ring drains. */
+void uart_write(const char *buf, unsigned len)
+{
+  if (!tx_irq_on) {
+    for (unsigned i = 0; i < len; i++)
+      printc(buf[i]);
+    return;
+  }
+  for (unsigned i = 0; i < len; i++) {
+    unsigned irq = irq_save();
+    tx_put(buf[i]);
+    irq_restore(irq);
+  }
+  unsigned irq = irq_save();
+  tx_kick();
+  irq_restore(irq);
+}
+
+/* function: uart_tx_init
+   Description: Switch printc()/print() to the buffered, interrupt driven
+   transmit path. The caller still has to enable interrupts globally. */
+void uart_tx_init(enum uart_tx_policy policy)
+{
+  unsigned irq = irq_save();
+  tx_policy = policy;
+  tx_irq_on = 1;
+  irq_restore(irq);
+  irq_register(JTAG_UART_IRQ, uart_tx_isr, 0);
+}
+
+/* function: uart_tx_isr
+   Description: JTAG UART interrupt handler, refills the hardware FIFO and
+   masks the write-space interrupt again once the ring is empty.
+   Registered for JTAG_UART_IRQ by uart_tx_init(). */
+void uart_tx_isr(unsigned cause, void *ctx)
+{
+  (void)cause;
+  (void)ctx;
+  tx_drain();
+  if (tx_head == tx_tail)
+    *JTAG_CTRL = 0;
+}
+
+void uart_tx_get_stats(struct uart_tx_stats *st)
+{
+  unsigned irq = irq_save();
+  st->queued = tx_head - tx_tail;
+  st->dropped = tx_dropped;
+  st->overwritten = tx_overwritten;
+  irq_restore(irq);
+}
+
+/* function: flush
+   Description: Busy-wait until every queued byte has been handed to the UART. */
+void flush(void)
+{
+  while (tx_head != tx_tail) {
+    unsigned irq = irq_save();
+    tx_drain();
+    irq_restore(irq);
   }
 }
 
 void print_dec(unsigned int x)
 {
-  unsigned divident = 1000000000;
-  char first = 0;
-  do {
-    int dv = x / divident;
-    if (dv != 0) first = 1;
-    if (first != 0)
-      printc(48+dv);
-    x -= dv*divident;
-    divident /= 10;
-  } while (divident != 0);
-    if (first == 0)
-	printc(48);
+  char buf[FMT_U32_LEN];
+  fmt_u32(buf, x);
+  print(buf);
 }
 
 void print_hex32 ( unsigned int x)
 {
-  printc('0');
-  printc('x');
-  for (int i = 7; i >= 0; i--) {
-    char hd = (char) ((x >> (i*4)) & 0xf);
-    if (hd < 10)
-      hd += '0';
-    else
-      hd += ('A' - 10);
-    printc(hd);
-  }   
+  unsigned buf[3];              /* word aligned for fmt_hex8() */
+  print("0x");
+  fmt_hex8((char *)buf, x);
+  print((char *)buf);
 }
 
+#ifdef DTEKV_FULL_TRAP_FRAME
+/* Saved x1..x31 of the trap being handled, x_n at trap_frame[n-1]
+   (trap_frame[1], the sp slot, is not a register). Set by boot.S. */
+unsigned *trap_frame;
+
+static void dump_trap_frame(void)
+{
+  for (int n = 1; n < 32; n++) {
+    if (n == 2)
+      continue;
+    printc('x');
+    print_dec(n);
+    print(n < 10 ? "  = " : " = ");
+    print_hex32(trap_frame[n - 1]);
+    printc((n & 3) == 3 ? '\n' : ' ');
+  }
+  printc('\n');
+}
+#endif
+
 /* function: handle_exception
-   Description: This code handles an exception. */
+   Description: This code handles an exception. Environment calls do not
+   come here; boot.S hands them to syscall_table (dtekv-syscall.c). */
 void handle_exception ( unsigned arg0, unsigned arg1, unsigned arg2, unsigned arg3, unsigned arg4, unsigned arg5, unsigned mcause, unsigned syscall_num )
 {
   switch (mcause)
@@ -59,13 +202,6 @@ void handle_exception ( unsigned arg0, unsigned arg1, unsigned arg2, unsigned ar
     case 2:
       print("\n[EXCEPTION] Illegal instruction. "); 
       break;
-    case 11:
-      if (syscall_num == 4)
-	print((char*) arg0); 
-      if (syscall_num == 11)
-	printc(arg0);
-      return ;
-      break;
     default:
       print("\n[EXCEPTION] Unknown error. ");
       break;
@@ -73,54 +209,9 @@ void handle_exception ( unsigned arg0, unsigned arg1, unsigned arg2, unsigned ar
   
   print("Exception Address: ");
   print_hex32(arg0); printc('\n');
+#ifdef DTEKV_FULL_TRAP_FRAME
+  dump_trap_frame();
+#endif
+  flush();
   while (1);
 }
-
-/*
- * nextprime
- * 
- * Return the first prime number larger than the integer
- * given as a parameter. The integer must be positive.
- */
-#define PRIME_FALSE   0     /* Constant to help readability. */
-#define PRIME_TRUE    1     /* Constant to help readability. */
-int nextprime( int inval )
-{
-   register int perhapsprime = 0; /* Holds a tentative prime while we check it. */
-   register int testfactor; /* Holds various factors for which we test perhapsprime. */
-   register int found;      /* Flag, false until we find a prime. */
-
-   if (inval < 3 )          /* Initial sanity check of parameter. */
-   {
-     if(inval <= 0) return(1);  /* Return 1 for zero or negative input. */
-     if(inval == 1) return(2);  /* Easy special case. */
-     if(inval == 2) return(3);  /* Easy special case. */
-   }
-   else
-   {
-     /* Testing an even number for primeness is pointless, since
-      * all even numbers are divisible by 2. Therefore, we make sure
-      * that perhapsprime is larger than the parameter, and odd. */
-     perhapsprime = ( inval + 1 ) | 1 ;
-   }
-   /* While prime not found, loop. */
-   for( found = PRIME_FALSE; found != PRIME_TRUE; perhapsprime += 2 )
-   {
-     /* Check factors from 3 up to perhapsprime/2. */
-     for( testfactor = 3; testfactor <= (perhapsprime >> 1) + 1; testfactor += 1 )
-     {
-       found = PRIME_TRUE;      /* Assume we will find a prime. */
-       if( (perhapsprime % testfactor) == 0 ) /* If testfactor divides perhapsprime... */
-       {
-         found = PRIME_FALSE;   /* ...then, perhapsprime was non-prime. */
-         goto check_next_prime; /* Break the inner loop, go test a new perhapsprime. */
-       }
-     }
-     check_next_prime:;         /* This label is used to break the inner loop. */
-     if( found == PRIME_TRUE )  /* If the loop ended normally, we found a prime. */
-     {
-       return( perhapsprime );  /* Return the prime we found. */
-     } 
-   }
-   return( perhapsprime );      /* When the loop ends, perhapsprime is a real prime. */
-} 
@@ -0,0 +1,315 @@
+/* dtekv-mem.c
+   Little-endian word shuffling: with the source sh bits past a word
+   boundary, the destination word is the high bytes of one aligned
+   source word (w0 >> sh) and the low bytes of the next (w1 << (32 - sh)).
+
+   gcc turns loops it recognises as a copy or fill into calls to memcpy or
+   memset, which here would call themselves; MEM_NOLIBCALL stops that for
+   the functions below. */
+
+#include "dtekv-mem.h"
+
+#ifdef DTEKV_BENCH
+#include "dtekv-lib.h"
+#include "dtekv-fmt.h"
+#endif
+
+#define MEM_NOLIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+/* A word that may alias anything, so the word loops are not reordered
+   around byte accesses to the same memory. */
+typedef unsigned mem_word __attribute__((__may_alias__));
+
+/* Copy n bytes upwards. Safe for overlapping buffers with dst below src:
+   every word is loaded before anything at or above it is stored. */
+static MEM_NOLIBCALL void mem_copy_up(unsigned char *d, const unsigned char *s, unsigned n)
+{
+  if (n >= 8) {
+    while ((unsigned)d & 3) {
+      *d++ = *s++;
+      n--;
+    }
+    if (((unsigned)s & 3) == 0) {
+      mem_word *dw = (mem_word *)d;
+      const mem_word *sw = (const mem_word *)s;
+
+      for (; n >= 32; n -= 32, dw += 8, sw += 8) {
+        unsigned w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+        unsigned w4 = sw[4], w5 = sw[5], w6 = sw[6], w7 = sw[7];
+
+        dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+        dw[4] = w4; dw[5] = w5; dw[6] = w6; dw[7] = w7;
+      }
+      for (; n >= 4; n -= 4)
+        *dw++ = *sw++;
+      d = (unsigned char *)dw;
+      s = (const unsigned char *)sw;
+    } else {
+      unsigned off = (unsigned)s & 3, sh = off * 8;
+      const mem_word *sw = (const mem_word *)(s - off);
+      mem_word *dw = (mem_word *)d;
+      unsigned w0 = *sw++;            /* holds the next 4 - off source bytes */
+
+      for (; n >= 16; n -= 16, dw += 4, sw += 4) {
+        unsigned w1 = sw[0], w2 = sw[1], w3 = sw[2], w4 = sw[3];
+
+        dw[0] = w0 >> sh | w1 << (32 - sh);
+        dw[1] = w1 >> sh | w2 << (32 - sh);
+        dw[2] = w2 >> sh | w3 << (32 - sh);
+        dw[3] = w3 >> sh | w4 << (32 - sh);
+        w0 = w4;
+      }
+      for (; n >= 4; n -= 4) {
+        unsigned w1 = *sw++;
+
+        *dw++ = w0 >> sh | w1 << (32 - sh);
+        w0 = w1;
+      }
+      d = (unsigned char *)dw;
+      s = (const unsigned char *)(sw - 1) + off;
+    }
+  }
+  while (n--)
+    *d++ = *s++;
+}
+
+/* Copy n bytes downwards, from the top end; for dst above src. */
+static MEM_NOLIBCALL void mem_copy_down(unsigned char *d, const unsigned char *s, unsigned n)
+{
+  d += n;
+  s += n;
+  if (n >= 8) {
+    while ((unsigned)d & 3) {
+      *--d = *--s;
+      n--;
+    }
+    if (((unsigned)s & 3) == 0) {
+      mem_word *dw = (mem_word *)d;
+      const mem_word *sw = (const mem_word *)s;
+
+      for (; n >= 32; n -= 32) {
+        unsigned w0, w1, w2, w3, w4, w5, w6, w7;
+
+        sw -= 8;
+        dw -= 8;
+        w7 = sw[7]; w6 = sw[6]; w5 = sw[5]; w4 = sw[4];
+        w3 = sw[3]; w2 = sw[2]; w1 = sw[1]; w0 = sw[0];
+        dw[7] = w7; dw[6] = w6; dw[5] = w5; dw[4] = w4;
+        dw[3] = w3; dw[2] = w2; dw[1] = w1; dw[0] = w0;
+      }
+      for (; n >= 4; n -= 4)
+        *--dw = *--sw;
+      d = (unsigned char *)dw;
+      s = (const unsigned char *)sw;
+    } else {
+      unsigned off = (unsigned)s & 3, sh = off * 8;
+      const mem_word *sw = (const mem_word *)(s - off);
+      mem_word *dw = (mem_word *)d;
+      unsigned w1 = *sw;              /* holds the off source bytes below s */
+
+      for (; n >= 16; n -= 16) {
+        unsigned w0, w2, w3, w4;
+
+        sw -= 4;
+        dw -= 4;
+        w4 = sw[3]; w3 = sw[2]; w2 = sw[1]; w0 = sw[0];
+        dw[3] = w4 >> sh | w1 << (32 - sh);
+        dw[2] = w3 >> sh | w4 << (32 - sh);
+        dw[1] = w2 >> sh | w3 << (32 - sh);
+        dw[0] = w0 >> sh | w2 << (32 - sh);
+        w1 = w0;
+      }
+      for (; n >= 4; n -= 4) {
+        unsigned w0 = *--sw;
+
+        *--dw = w0 >> sh | w1 << (32 - sh);
+        w1 = w0;
+      }
+      d = (unsigned char *)dw;
+      s = (const unsigned char *)sw + off;
+    }
+  }
+  while (n--)
+    *--d = *--s;
+}
+
+void *memcpy(void *dst, const void *src, unsigned n)
+{
+  mem_copy_up(dst, src, n);
+  return dst;
+}
+
+/* function: memmove
+   Description: Copies upwards unless dst starts inside src, in which
+   case from the top down. The unsigned difference is at least n both
+   when dst is below src and when it is at or past its end. */
+void *memmove(void *dst, const void *src, unsigned n)
+{
+  if ((unsigned)dst - (unsigned)src >= n)
+    mem_copy_up(dst, src, n);
+  else if (dst != src)
+    mem_copy_down(dst, src, n);
+  return dst;
+}
+
+MEM_NOLIBCALL void *memset(void *dst, int c, unsigned n)
+{
+  unsigned char *d = dst;
+
+  if (n >= 8) {
+    unsigned w = (unsigned char)c * 0x01010101u;
+    mem_word *dw;
+
+    while ((unsigned)d & 3) {
+      *d++ = (unsigned char)c;
+      n--;
+    }
+    dw = (mem_word *)d;
+    for (; n >= 32; n -= 32, dw += 8) {
+      dw[0] = w; dw[1] = w; dw[2] = w; dw[3] = w;
+      dw[4] = w; dw[5] = w; dw[6] = w; dw[7] = w;
+    }
+    for (; n >= 4; n -= 4)
+      *dw++ = w;
+    d = (unsigned char *)dw;
+  }
+  while (n--)
+    *d++ = (unsigned char)c;
+  return dst;
+}
+
+/* function: memcmp
+   Description: Compares a word at a time until two words differ, then
+   finds the byte in them one at a time. b is shift-merged as memcpy
+   does the source when the two are not equally aligned. */
+int memcmp(const void *a, const void *b, unsigned n)
+{
+  const unsigned char *p = a, *q = b;
+
+  if (n >= 8) {
+    const mem_word *pw;
+
+    while ((unsigned)p & 3) {
+      if (*p != *q)
+        return *p - *q;
+      p++;
+      q++;
+      n--;
+    }
+    pw = (const mem_word *)p;
+    if (((unsigned)q & 3) == 0) {
+      const mem_word *qw = (const mem_word *)q;
+
+      for (; n >= 8 && pw[0] == qw[0] && pw[1] == qw[1]; n -= 8)
+        pw += 2, qw += 2;
+      for (; n >= 4 && *pw == *qw; n -= 4)
+        pw++, qw++;
+      q = (const unsigned char *)qw;
+    } else {
+      unsigned off = (unsigned)q & 3, sh = off * 8;
+      const mem_word *qw = (const mem_word *)(q - off);
+      unsigned w0 = *qw++;
+
+      for (; n >= 4; n -= 4, pw++) {
+        unsigned w1 = *qw;
+
+        if (*pw != (w0 >> sh | w1 << (32 - sh)))
+          break;
+        qw++;
+        w0 = w1;
+      }
+      q = (const unsigned char *)(qw - 1) + off;
+    }
+    p = (const unsigned char *)pw;
+  }
+  for (; n; n--, p++, q++)
+    if (*p != *q)
+      return *p - *q;
+  return 0;
+}
+
+#ifdef DTEKV_BENCH
+#define MEM_BENCH_MAX (64 * 1024)
+
+static unsigned char mem_bench_src[MEM_BENCH_MAX + 16] __attribute__((aligned(4)));
+static unsigned char mem_bench_dst[MEM_BENCH_MAX + 16] __attribute__((aligned(4)));
+
+enum { MB_BYTES, MB_CPY, MB_MOVE, MB_SET, MB_CMP };
+
+static MEM_NOLIBCALL void mem_bytes(unsigned char *d, const unsigned char *s, unsigned n)
+{
+  while (n--)
+    *d++ = *s++;
+}
+
+/* Cycles for reps calls of the function with dst and src at the given
+   offsets from a word boundary. memmove copies down over itself. */
+static unsigned mb_cycles(int kind, unsigned doff, unsigned soff,
+                          unsigned n, unsigned reps)
+{
+  unsigned char *d = mem_bench_dst + doff, *s = mem_bench_src + soff;
+  volatile int sink = 0;
+  unsigned t0;
+
+  if (kind == MB_MOVE) {
+    s = mem_bench_dst + soff;
+    d = mem_bench_dst + 8 + doff;
+  }
+  t0 = read_mcycle();
+  for (unsigned r = 0; r < reps; r++) {
+    switch (kind) {
+    case MB_BYTES: mem_bytes(d, s, n); break;
+    case MB_CPY:   memcpy(d, s, n); break;
+    case MB_MOVE:  memmove(d, s, n); break;
+    case MB_SET:   memset(d, 0x5a, n); break;
+    default:       sink += memcmp(d, s, n); break;
+    }
+  }
+  return read_mcycle() - t0;
+}
+
+/* function: mem_bench
+   Description: Bytes per cycle for each function over sizes from 1 byte
+   to 64 KiB in steps of 4x, at all sixteen alignments of dst and src.
+   A column is one src - dst offset mod 4, and shows the slowest of its
+   four dst offsets; for memset, each column is a dst offset. The memcpy
+   table starts with a plain byte loop, aligned, for comparison. Both
+   buffers hold the same byte throughout, so memcmp reads all of them. */
+void mem_bench(void)
+{
+  static const char *const names[] = { 0, "memcpy", "memmove", "memset", "memcmp" };
+
+  memset(mem_bench_src, 0x5a, sizeof mem_bench_src);
+  memset(mem_bench_dst, 0x5a, sizeof mem_bench_dst);
+  for (int kind = MB_CPY; kind <= MB_CMP; kind++) {
+    print("mem_bench: ");
+    print(names[kind]);
+    print(kind == MB_SET ? " bytes/cycle by dst offset\n"
+                         : " bytes/cycle by src - dst offset\n");
+    print(kind == MB_CPY ? "     size   byte" : "     size");
+    print("     +0     +1     +2     +3\n");
+    for (unsigned n = 1; n <= MEM_BENCH_MAX; n *= 4) {
+      unsigned reps = n < 4096 ? 4096 / n : 1;
+
+      print_col(n, 9);
+      if (kind == MB_CPY)
+        print_rate(n * reps, mb_cycles(MB_BYTES, 0, 0, n, reps), 7);
+      for (unsigned rel = 0; rel < 4; rel++) {
+        unsigned worst = 0;
+
+        for (unsigned doff = 0; doff < 4; doff++) {
+          unsigned soff = kind == MB_SET ? 0 : (doff + rel) & 3;
+          unsigned c = mb_cycles(kind, kind == MB_SET ? rel : doff, soff, n, reps);
+
+          if (c > worst)
+            worst = c;
+          if (kind == MB_SET)
+            break;
+        }
+        print_rate(n * reps, worst, 7);
+      }
+      printc('\n');
+    }
+  }
+}
+#endif
@@ -0,0 +1,141 @@
+#ifndef DTEKV_THREAD_H
+#define DTEKV_THREAD_H
+
+/* Preemptive threads with fixed priorities and round-robin time slices.
+
+     static struct thread worker;
+     timer_init(TIMER_TICKLESS, 0);
+     thread_init(10000, 1);             main becomes a thread, 10 ms slices
+     thread_create(&worker, "worker", work, 0, 4096, 1);
+     enable_interrupt();
+
+   The highest-priority ready thread runs. Threads of the same priority
+   take turns: a periodic soft timer ends the running thread's slice when
+   another thread of its priority (or a higher one) is ready. A thread
+   made ready by an interrupt handler with sem_post_isr() runs as soon as
+   the handler returns if it outranks the interrupted one. The switch
+   itself is in boot.S: the outermost interrupt handler's exit path, and
+   thread_switch() for a thread that blocks or yields, both leave the
+   thread's registers in a trap frame on its own stack and resume the
+   next thread from its frame.
+
+   The target has no atomic instructions, so the thread lists are only
+   ever changed with interrupts masked. Thread stacks come from the task
+   stack region of dtekv-script.lds; every interrupt taken while a thread
+   runs pushes its frame on that thread's stack. Each thread keeps its
+   own open PROF regions, so a region in which it is preempted or blocks
+   counts only the time it ran, with the interrupts it took. */
+
+#include "dtekv-prof.h"
+
+/* Priorities 0 (lowest) .. THREAD_PRIOS - 1. The idle thread is below
+   all of them. */
+#define THREAD_PRIOS 8
+
+/* Smallest stack thread_create() accepts: two trap frames for every
+   interrupt priority level and a little to run on. */
+#define THREAD_STACK_MIN 1024
+
+enum thread_state {
+  THREAD_READY,     /* on a run queue, or running */
+  THREAD_BLOCKED,   /* on the wait list of a semaphore or mutex */
+  THREAD_DONE       /* its function returned */
+};
+
+typedef void (*thread_fn_t)(unsigned arg);
+
+/* A thread control block. The caller provides the storage, which must
+   stay valid for as long as the thread exists. */
+struct thread {
+  unsigned sp;                  /* saved by boot.S while not running */
+  const char *name;
+  unsigned char prio;
+  unsigned char state;
+  struct thread *next;          /* run queue or wait list */
+  struct thread *all;           /* every thread, for thread_report() */
+  unsigned *stack_lo;           /* lowest word holds a canary */
+  unsigned stack_size;
+  unsigned long long cycles;    /* mcycle spent running */
+  unsigned runs;                /* times it was switched to */
+  unsigned preempted;           /* times the CPU was taken from it */
+#ifdef DTEKV_PROF
+  struct prof_stack prof;       /* its open regions while not running */
+#endif
+};
+
+/* A counting semaphore. */
+struct sem {
+  int count;
+  struct thread *waiters;       /* highest priority first */
+};
+
+/* A mutex, locked by one thread at a time and unlocked by the same one;
+   not recursive, and no priority inheritance. */
+struct mutex {
+  struct thread *owner;
+  struct thread *waiters;       /* highest priority first */
+};
+
+struct thread_stats {
+  unsigned switches;            /* one thread to another */
+  unsigned preemptions;         /* of those, at the end of an interrupt */
+  unsigned slices;              /* time slices that ended in a switch */
+  unsigned slice;               /* time slice in timer cycles, 0 if none */
+};
+
+/* Set by the time slice and by anything that readies a thread that
+   outranks the running one; boot.S switches threads when it is set on
+   the way out of an interrupt taken at thread level. */
+extern volatile unsigned thread_resched;
+
+/* Make the caller thread "main" with priority main_prio, on the boot
+   stack, and start the time slice: slice_us, or none if it is 0. Needs
+   timer_init() for a slice; call before enable_interrupt(). */
+void thread_init(unsigned slice_us, unsigned main_prio);
+
+/* Set up t to run fn(arg) at priority prio with a stack of stack_size
+   bytes (rounded up to 16). It runs at once if it outranks the caller.
+   Returns 0, or -1 if the stack is below THREAD_STACK_MIN or there is no
+   room for it, or prio is out of range. */
+int thread_create(struct thread *t, const char *name, thread_fn_t fn,
+                  unsigned arg, unsigned stack_size, unsigned prio);
+
+/* Let the other ready threads of the caller's priority run first. */
+void thread_yield(void);
+
+/* End the calling thread; what returning from its function does. */
+void thread_exit(void);
+
+struct thread *thread_self(void);
+
+void sem_init(struct sem *s, int count);
+
+/* Take one unit, waiting for it if there is none. Threads only. */
+void sem_wait(struct sem *s);
+
+/* Take one unit and return 1, or return 0 at once if there is none. */
+int sem_trywait(struct sem *s);
+
+/* Give one unit, to the highest-priority waiter if there is one.
+   sem_post() is for threads and switches at once if the waiter outranks
+   the caller; sem_post_isr() is for interrupt handlers and leaves the
+   switch to the end of the interrupt. */
+void sem_post(struct sem *s);
+void sem_post_isr(struct sem *s);
+
+void mutex_init(struct mutex *m);
+void mutex_lock(struct mutex *m);
+/* Only by the owner; anything else halts with a message. */
+void mutex_unlock(struct mutex *m);
+
+void thread_get_stats(struct thread_stats *st);
+
+/* One line per thread: priority, runs, times preempted, share of the
+   CPU and stack use; then the switch counts. */
+void thread_report(void);
+
+#ifdef DTEKV_BENCH
+void thread_bench(void);
+#endif
+
+#endif
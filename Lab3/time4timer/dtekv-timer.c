@@ -0,0 +1,477 @@
+/* dtekv-timer.c
+   Software timers: a 64-bit time base on the interval timer and a
+   hierarchical timer wheel of pending deadlines.
+
+   The hardware counter counts down from the period register to 0 and,
+   with CONT set, reloads and keeps counting. tm_base is the time at which
+   the current period started, so the time is tm_base plus how far the
+   counter has come, read through SNAPL/H; a timeout not yet serviced adds
+   one more period. The interrupt moves tm_base on by a period.
+
+   In TIMER_PERIODIC mode the period never changes. In TIMER_TICKLESS
+   mode every interrupt (and every timer_start() that brings the next
+   deadline forward) folds the elapsed part of the period into tm_base
+   and writes a new period that ends at the next deadline, so an idle
+   system takes no interrupts at all. The counter stays in CONT mode so
+   that it keeps counting past a deadline until the interrupt is served;
+   only the few cycles between the snapshot and the restart are unseen,
+   and those are measured on mcycle, which runs at the same clock.
+
+   Wheel: times are cut into jiffies of 2^TIMER_WHEEL_SHIFT cycles. A
+   timer due in fewer than 32 jiffies sits on level 0 in the slot of its
+   jiffy; further out it goes to level l, whose slots are 32^l jiffies
+   wide, and is moved down ("cascaded") when the wheel reaches its slot.
+   tw_now is the next jiffy to run. A bitmap per level lets the wheel
+   skip empty slots and find the next deadline without walking lists. */
+
+#include "dtekv-timer.h"
+#include "dtekv-lib.h"
+#include "dtekv-irq.h"
+
+#ifndef TIMER_BASE
+#define TIMER_BASE 0x04000020u
+#endif
+#define TMR_REG(off)  (*(volatile unsigned *)(TIMER_BASE + (off)))
+#define TMR_STATUS    TMR_REG(0x00)
+#define TMR_CONTROL   TMR_REG(0x04)
+#define TMR_PERIODL   TMR_REG(0x08)
+#define TMR_PERIODH   TMR_REG(0x0C)
+#define TMR_SNAPL     TMR_REG(0x10)
+#define TMR_SNAPH     TMR_REG(0x14)
+#define ST_TO         (1u << 0)
+#define CTRL_ITO      (1u << 0)
+#define CTRL_CONT     (1u << 1)
+#define CTRL_START    (1u << 2)
+#define CTRL_STOP     (1u << 3)
+
+/* Limits of a tickless period: a deadline closer than one jiffy still
+   waits a jiffy, and with nothing pending the timer wakes every 71 s so
+   that no timeout is ever missed. */
+#define TM_MIN_PERIOD  (1u << TIMER_WHEEL_SHIFT)
+#define TM_MAX_PERIOD  0x80000000u
+
+#define TW_BITS   5
+#define TW_SIZE   (1u << TW_BITS)
+#define TW_MASK   (TW_SIZE - 1)
+#define TW_RANGE  (1u << (TW_BITS * TIMER_WHEEL_LEVELS))   /* in jiffies */
+
+static int tm_active;
+static enum timer_mode tm_mode;
+static unsigned long long tm_base;   /* time at which the current period began */
+static unsigned tm_period;           /* period register value: length - 1 */
+static int tm_in_isr;                /* the wheel is being run; rearm after it */
+static struct timer_stats tm_stats;
+
+static struct soft_timer *tw_slot[TIMER_WHEEL_LEVELS * TW_SIZE];
+static unsigned tw_map[TIMER_WHEEL_LEVELS];
+static unsigned tw_now;              /* next jiffy to run, modulo 2^32 */
+
+/* Count of trailing zeros, x != 0 (as in dtekv-sieve.c). */
+static unsigned ctz32(unsigned x)
+{
+  static const unsigned char debruijn[32] = {
+     0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8,
+    31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9
+  };
+  return debruijn[((x & (0u - x)) * 0x077CB531u) >> 27];
+}
+
+/* Distance from slot `from` to the first set bit of map at or after it,
+   wrapping around; map != 0. */
+static unsigned tw_distance(unsigned map, unsigned from)
+{
+  if (from)
+    map = (map >> from) | (map << (TW_SIZE - from));
+  return ctz32(map);
+}
+
+/* ---- hardware time base (all with interrupts masked) ---- */
+
+static unsigned tm_snap_cycle;       /* mcycle at the last snapshot */
+
+static unsigned tmr_snap(void)
+{
+  tm_snap_cycle = read_mcycle();
+  TMR_SNAPL = 0;
+  return (TMR_SNAPL & 0xffffu) | (TMR_SNAPH << 16);
+}
+
+/* Cycles since tm_base, including a timeout not serviced yet. If the
+   counter reloads between reading TO and the snapshot, TO reads
+   differently the second time and the snapshot is retaken. */
+static unsigned tmr_elapsed(void)
+{
+  unsigned to = TMR_STATUS & ST_TO;
+  unsigned snap = tmr_snap();
+  unsigned e;
+
+  if ((TMR_STATUS & ST_TO) != to) {
+    to = ST_TO;
+    snap = tmr_snap();
+  }
+  e = tm_period - snap;
+  if (to)
+    e += tm_period + 1;
+  return e;
+}
+
+/* Write a new period (register value) and restart the counter from it.
+   Returns mcycle just before the restart. */
+static unsigned tmr_load(unsigned period)
+{
+  unsigned c;
+
+  TMR_PERIODL = period & 0xffffu;      /* stops the timer and reloads */
+  TMR_PERIODH = period >> 16;
+  c = read_mcycle();
+  TMR_CONTROL = CTRL_ITO | CTRL_CONT | CTRL_START;
+  tm_period = period;
+  return c;
+}
+
+/* ---- wheel (all with interrupts masked) ---- */
+
+static void tw_link(struct soft_timer *t, unsigned slot)
+{
+  struct soft_timer **head = &tw_slot[slot];
+
+  t->slot = slot;
+  t->next = *head;
+  if (t->next)
+    t->next->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+  tw_map[slot >> TW_BITS] |= 1u << (slot & TW_MASK);
+}
+
+static void tw_unlink(struct soft_timer *t)
+{
+  *t->pprev = t->next;
+  if (t->next)
+    t->next->pprev = t->pprev;
+  t->pprev = 0;
+  if (tw_slot[t->slot] == 0)
+    tw_map[t->slot >> TW_BITS] &= ~(1u << (t->slot & TW_MASK));
+}
+
+/* First jiffy at or after the deadline, so that no timer fires early. */
+static unsigned tw_jiffy(unsigned long long deadline)
+{
+  return (unsigned)((deadline + (1u << TIMER_WHEEL_SHIFT) - 1) >> TIMER_WHEEL_SHIFT);
+}
+
+static void tw_insert(struct soft_timer *t)
+{
+  unsigned j = tw_jiffy(t->deadline);
+  unsigned delta = j - tw_now;
+  unsigned level = 0;
+
+  if ((int)delta < 0) {                /* already due: run with tw_now */
+    j = tw_now;
+    delta = 0;
+  } else if (delta >= TW_RANGE) {      /* beyond the wheel: park at its end */
+    j = tw_now + TW_RANGE - 1;
+    delta = TW_RANGE - 1;
+  }
+  while (delta >= TW_SIZE) {
+    delta >>= TW_BITS;
+    level++;
+  }
+  tw_link(t, level * TW_SIZE + ((j >> (level * TW_BITS)) & TW_MASK));
+}
+
+/* Move the timers of one slot down to where they belong now. */
+static void tw_cascade(unsigned level, unsigned idx)
+{
+  unsigned slot = level * TW_SIZE + idx;
+  struct soft_timer *t = tw_slot[slot];
+
+  tw_slot[slot] = 0;
+  tw_map[level] &= ~(1u << idx);
+  while (t) {
+    struct soft_timer *next = t->next;
+    tw_insert(t);
+    t = next;
+  }
+}
+
+/* Move tw_now to jiffy j, at most to the start of the next level-0 round,
+   and cascade the higher levels when a round begins. */
+static void tw_step(unsigned j)
+{
+  tw_now = j;
+  if ((j & TW_MASK) != 0)
+    return;
+  for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    unsigned idx = (j >> (level * TW_BITS)) & TW_MASK;
+    tw_cascade(level, idx);
+    if (idx != 0)
+      break;
+  }
+}
+
+/* Earliest jiffy at which the wheel has work: a level-0 deadline or a
+   cascade that may bring one down. Returns tw_now + TW_RANGE if empty. */
+static unsigned tw_next(void)
+{
+  unsigned best = TW_RANGE;
+
+  if (tw_map[0])
+    best = tw_distance(tw_map[0], tw_now & TW_MASK);
+  for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    unsigned shift = level * TW_BITS;
+    unsigned idx, k, j;
+
+    if (tw_map[level] == 0)
+      continue;
+    /* the current slot was cascaded when this round began, so a timer
+       in it is a whole turn of the level away */
+    idx = (tw_now >> shift) & TW_MASK;
+    k = tw_distance(tw_map[level], (idx + 1) & TW_MASK) + 1;
+    j = ((tw_now >> shift) + k) << shift;
+    if (j - tw_now < best)
+      best = j - tw_now;
+  }
+  return tw_now + best;
+}
+
+/* Run every timer due at or before jiffy now_j. Callbacks run with
+   interrupts enabled; everything that touches the wheel is masked. */
+static void tw_run(unsigned now_j)
+{
+  unsigned mie = irq_save();
+
+  while ((int)(now_j - tw_now) >= 0) {
+    struct soft_timer **head = &tw_slot[tw_now & TW_MASK];
+    struct soft_timer *t;
+    unsigned next;
+
+    while ((t = *head) != 0) {
+      timer_cb_t cb = t->cb;
+      unsigned long long late;
+
+      tw_unlink(t);
+      if (t->period) {                 /* requeue first: cb may stop it */
+        t->deadline += t->period;
+        tw_insert(t);
+      }
+      late = tm_base + tmr_elapsed() - (t->deadline - t->period);
+      if (late > tm_stats.late_max && (late >> 32) == 0)
+        tm_stats.late_max = (unsigned)late;
+      tm_stats.fired++;
+      irq_restore(mie);
+      cb(t, t->arg);
+      mie = irq_save();
+    }
+    /* skip to the next slot with work; every cascade on the way would
+       find its slot empty */
+    next = tw_next();
+    if ((int)(next - (now_j + 1)) > 0)
+      next = now_j + 1;
+    tw_step(next);
+  }
+  irq_restore(mie);
+}
+
+/* Tickless: end the current period at the next deadline. Masked. */
+static void tmr_rearm(void)
+{
+  unsigned long long now = tm_base + tmr_elapsed();
+  unsigned c0 = tm_snap_cycle, c1;
+  unsigned next = tw_next();
+  long long d;
+  unsigned period;
+
+  /* cycles to the start of jiffy next, which is within 2^31 jiffies */
+  d = ((long long)(int)(next - (unsigned)(now >> TIMER_WHEEL_SHIFT)) << TIMER_WHEEL_SHIFT)
+      - (long long)(now & ((1u << TIMER_WHEEL_SHIFT) - 1));
+  if (next - tw_now >= TW_RANGE || d >= (long long)TM_MAX_PERIOD)
+    period = TM_MAX_PERIOD;
+  else if (d <= (long long)TM_MIN_PERIOD)
+    period = TM_MIN_PERIOD;
+  else
+    period = (unsigned)d;
+
+  c1 = tmr_load(period - 1);
+  TMR_STATUS = 0;                      /* a pending timeout is in now */
+#if CPU_CLK_HZ == TIMER_CLK_HZ
+  tm_base = now + (c1 - c0);
+#else
+  (void)c0;
+  (void)c1;
+  tm_base = now;
+#endif
+  tm_stats.reprograms++;
+}
+
+static void timer_isr(unsigned cause, void *ctx)
+{
+  unsigned mie;
+  unsigned long long now;
+
+  (void)cause;
+  (void)ctx;
+  mie = irq_save();
+  if (TMR_STATUS & ST_TO) {
+    TMR_STATUS = 0;
+    tm_base += (unsigned long long)tm_period + 1;
+  }
+  tm_stats.irqs++;
+  now = tm_base + tmr_elapsed();
+  tm_in_isr = 1;
+  irq_restore(mie);
+
+  tw_run((unsigned)(now >> TIMER_WHEEL_SHIFT));
+
+  mie = irq_save();
+  tm_in_isr = 0;
+  if (tm_mode == TIMER_TICKLESS)
+    tmr_rearm();
+  irq_restore(mie);
+}
+
+void timer_init(enum timer_mode mode, unsigned tick_hz)
+{
+  unsigned mie = irq_save();
+
+  TMR_CONTROL = CTRL_STOP;
+  TMR_STATUS = 0;
+  tm_mode = mode;
+  tm_base = 0;
+  tw_now = 0;
+  if (mode == TIMER_PERIODIC && tick_hz != 0)
+    tmr_load(TIMER_CLK_HZ / tick_hz - 1);
+  else
+    tmr_load(TM_MAX_PERIOD - 1);
+  irq_register(IRQ_TIMER, timer_isr, 0);
+  tm_active = 1;
+  irq_restore(mie);
+}
+
+int timer_active(void)
+{
+  return tm_active;
+}
+
+unsigned long long timer_now(void)
+{
+  unsigned mie = irq_save();
+  unsigned long long now = tm_base + tmr_elapsed();
+
+  irq_restore(mie);
+  return now;
+}
+
+static void timer_add(struct soft_timer *t, unsigned long long deadline,
+                      unsigned period, timer_cb_t cb, void *arg)
+{
+  unsigned mie = irq_save();
+
+  if (t->pprev)
+    tw_unlink(t);
+  t->deadline = deadline;
+  t->period = period;
+  t->cb = cb;
+  t->arg = arg;
+  tw_insert(t);
+  /* the interrupt rearms when it is done; otherwise bring the end of the
+     period forward if this deadline comes first */
+  if (tm_mode == TIMER_TICKLESS && !tm_in_isr
+      && deadline < tm_base + tm_period + 1)
+    tmr_rearm();
+  irq_restore(mie);
+}
+
+void timer_start(struct soft_timer *t, unsigned long long deadline,
+                 timer_cb_t cb, void *arg)
+{
+  timer_add(t, deadline, 0, cb, arg);
+}
+
+void timer_start_periodic(struct soft_timer *t, unsigned long long first,
+                          unsigned period, timer_cb_t cb, void *arg)
+{
+  timer_add(t, first, period, cb, arg);
+}
+
+void timer_stop(struct soft_timer *t)
+{
+  unsigned mie = irq_save();
+
+  if (t->pprev)
+    tw_unlink(t);
+  irq_restore(mie);
+}
+
+void timer_get_stats(struct timer_stats *st)
+{
+  unsigned mie = irq_save();
+
+  st->irqs = tm_stats.irqs;
+  st->reprograms = tm_stats.reprograms;
+  st->fired = tm_stats.fired;
+  st->late_max = tm_stats.late_max;
+  irq_restore(mie);
+}
+
+#ifdef DTEKV_BENCH
+
+#define TB_TIMERS 32
+
+static volatile unsigned tb_fired;
+
+static void tb_cb(struct soft_timer *t, void *arg)
+{
+  (void)t;
+  (void)arg;
+  tb_fired++;
+}
+
+/* function: timer_bench
+   Description: cost of timer_now() and of a start/stop pair, then
+   TB_TIMERS one-shot timers spread over 3.2 ms: how many interrupts
+   they took and how late the latest callback ran. Needs timer_init()
+   and interrupts enabled. */
+void timer_bench(void)
+{
+  static struct soft_timer tb[TB_TIMERS];
+  struct timer_stats s0, s1;
+  unsigned best_now = 0xffffffffu, best_ss = 0xffffffffu;
+  unsigned long long t0;
+
+  for (int i = 0; i < 8; i++) {
+    unsigned c0 = read_mcycle();
+    (void)timer_now();
+    unsigned c1 = read_mcycle();
+    timer_start(&tb[0], timer_now() + TIMER_MS(100), tb_cb, 0);
+    timer_stop(&tb[0]);
+    unsigned c2 = read_mcycle();
+    if (c1 - c0 < best_now)
+      best_now = c1 - c0;
+    if (c2 - c1 < best_ss)
+      best_ss = c2 - c1;
+  }
+
+  timer_get_stats(&s0);
+  tb_fired = 0;
+  t0 = timer_now();
+  for (int i = 0; i < TB_TIMERS; i++)
+    timer_start(&tb[i], t0 + TIMER_US(100) * (unsigned)(i + 1), tb_cb, 0);
+  while (tb_fired < TB_TIMERS)
+    ;
+  timer_get_stats(&s1);
+
+  print("timer: now ");
+  print_dec(best_now);
+  print(" cycles, start+stop ");
+  print_dec(best_ss);
+  print(" cycles\ntimer: ");
+  print_dec(TB_TIMERS);
+  print(" deadlines in ");
+  print_dec(s1.irqs - s0.irqs);
+  print(" interrupts, latest callback ");
+  print_dec(s1.late_max);
+  print(" cycles late\n");
+}
+
+#endif
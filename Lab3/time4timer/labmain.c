@@ -6,11 +6,16 @@
 */
 
 #include <stdint.h>
+#include "dtekv-prof.h"
+#include "dtekv-hex.h"
+#include "dtekv-bcd.h"
+#include "dtekv-boot.h"
+#include "dtekv-gpio.h"
 
 /* ===== externs from support files (unchanged) ===== */
 extern void print(const char*);
 extern void print_dec(unsigned int);
-extern void display_string(int, char*);
+extern void display_string(char*);
 extern void time2string(char*, int);
 extern void tick(int*);
 extern int nextprime(int);
@@ -51,23 +56,13 @@ extern int nextprime(int);
 #define ST_RUN       (1u << 1)   /* running (RO) */
 
 /* ===== globals from template ===== */
-int  mytime       = 0x5957;
+int  mytime       = 0x5957;                     /* HH:MM:SS, packed BCD */
 char textstring[] = "text, more text, and even more text!";
-volatile unsigned int timeoutcount = 0;
 
-/* Active-low seven-seg LUT for 0..9 (DP = bit7) */
-const int LED_NBR[] = {
-    64,  /* 0 */
-    121, /* 1 */
-    36,  /* 2 */
-    48,  /* 3 */
-    25,  /* 4 */
-    18,  /* 5 */
-    2,   /* 6 */
-    120, /* 7 */
-    0,   /* 8 */
-    16   /* 9 */
-};
+PROF_REGION(p_time2string, "time2string");
+PROF_REGION(p_tick, "tick");
+
+volatile unsigned int timeoutcount = 0;
 
 /* ===== (c) Assignment 1 function: LEDs ===== */
 void set_leds(int led_mask) {
@@ -76,14 +71,12 @@ void set_leds(int led_mask) {
 
 /* ===== (e) Assignment 1 function: one HEX digit to one display ===== */
 void set_displays(int display_number, int value) {
-    if (display_number < 0 || display_number > 5) return;  /* HEX0..HEX5 */
+    struct hex_frame f;
 
-    volatile unsigned int *disp =
-        (volatile unsigned int *)(HEX_BASE + (unsigned)display_number * HEX_STRIDE);
-
-    unsigned int patt = ((unsigned int)LED_NBR[value & 0xF]) & 0xFFu;
-    patt |= 0x80u; /* DP off (active-low) */
-    *disp = patt;
+    hex_frame_init(&f);   /* goes through the HEX framebuffer: a digit
+                             that already shows value is not rewritten */
+    hex_frame_glyph(&f, (unsigned)display_number, (unsigned)value & 0xFu);
+    hex_flush(&f);        /* HEX0..HEX5 only, DP off */
 }
 
 /* ===== (f) Assignment 1 function: read 10 switches ===== */
@@ -96,14 +89,14 @@ int get_btn(void) {
     return (int)((*BTN2_ADDR) & 0x1u);
 }
 
-/* Helper: HH:MM:SS → HEX5..HEX0 (HEX0 is rightmost) */
-static void show_time(int h, int m, int s) {
-    set_displays(0, s % 10);
-    set_displays(1, (s / 10) % 10);
-    set_displays(2, m % 10);
-    set_displays(3, (m / 10) % 10);
-    set_displays(4, h % 10);
-    set_displays(5, (h / 10) % 10);
+/* Helper: HH:MM:SS → HEX5..HEX0 (HEX0 is rightmost)
+   The clock is packed BCD (0x00HHMMSS): each nibble is one digit. */
+static void show_time(unsigned hhmmss) {
+    struct hex_frame f;
+
+    hex_frame_init(&f);
+    hex_frame_nibbles(&f, 0, 6, hhmmss);
+    hex_flush(&f);   /* one update; usually only HEX0 changes */
 }
 
 /* ===== Assignment 2 (a/b): timer init (100 ms @ 30 MHz), poll TO =====
@@ -131,31 +124,33 @@ void handle_interrupt(unsigned cause) { (void)cause; }
    - On TO: ACK, heartbeat LED, timeoutcount++
    - When timeoutcount == 10 (i.e., 1 s), update ASCII time + HH:MM:SS on HEX */
 int main(void) {
+    boot_report();                     /* banner, boot cycles, memory map */
     labinit();
 
-    int hr = 0, min = 0, sec = 0;
+    unsigned clock = 0;      /* HH:MM:SS, packed BCD */
     int heartbeat = 0;
 
     /* Show something deterministic at power-up on HEX */
-    show_time(hr, min, sec);
+    show_time(clock);
     set_leds(0);
+    gpio_init(GPIO_SWITCHES | GPIO_BIT(GPIO_BTN), 20);  /* polled */
 
     while (1) {
-        /* Always sample inputs (don’t depend on TO for reads) */
-        int sw  = get_sw();
-        int btn = get_btn();
-
         /* Button-driven set (same mapping as A1h):
            SW[9:8] = 01 => seconds, 10 => minutes, 11 => hours
-           SW[5:0] new value (0..63), clamped */
-        if (btn) {
+           SW[5:0] new value (0..63), clamped.
+           Debounced events, so holding the button stops nothing */
+        struct gpio_event ev;
+        while (gpio_read_event(&ev)) {
+            if (ev.pin != GPIO_BTN || !ev.level)
+                continue;
+            int sw  = (int)(gpio_levels() & GPIO_SWITCHES);
             int sel = (sw >> 8) & 0x3;
             int val = sw & 0x3F;
-            if      (sel == 1) sec = val % 60;
-            else if (sel == 2) min = val % 60;
-            else if (sel == 3) hr  = val % 100;
-            while (get_btn()) { /* crude debounce: wait for release */ }
-            show_time(hr, min, sec);
+            if      (sel == 1) clock = (clock & ~0xFFu)     | bin2bcd((unsigned)val % 60);
+            else if (sel == 2) clock = (clock & ~0xFF00u)   | bin2bcd((unsigned)val % 60) << 8;
+            else if (sel == 3) clock = (clock & ~0xFF0000u) | bin2bcd((unsigned)val % 100) << 16;
+            show_time(clock);
         }
 
         /* ---- Timer polling ---- */
@@ -173,19 +168,19 @@ By writing a ‘1’ back to the TO bit in the STATUS register*/
                 timeoutcount = 0;
 
                 /* Terminal text (kept from template) */
+                PROF_BEGIN(p_time2string);
                 time2string(textstring, mytime);
-                display_string(3, textstring);
-                tick(&mytime);
-
-                /* HH:MM:SS (software clock) */
-                if (++sec >= 60) {
-                    sec = 0;
-                    if (++min >= 60) {
-                        min = 0;
-                        if (++hr >= 100) hr = 0;  /* two digits for hours */
-                    }
-                }
-                show_time(hr, min, sec);
+                PROF_END(p_time2string);
+                display_string(textstring);
+                PROF_BEGIN(p_tick);
+                mytime = (int)bcd_clock_inc((unsigned)mytime, &bcd_clock_100h);
+                PROF_END(p_tick);
+
+                /* HH:MM:SS (software clock, two digits for hours) */
+                clock = bcd_clock_inc(clock, &bcd_clock_100h);
+                if ((clock & 0xFFu) == 0)
+                    PROF_DUMP();            /* profile table once a minute */
+                show_time(clock);
             }
         }
     }
@@ -50,7 +50,7 @@ int main()
   /* Local variables. */
   int m;
   int * p; /* Declare p as pointer, so that p can hold an address. */
-  char cs[ 9 ] = "Bonjour!";
+  char cs[ 9 ] = "Bonjour!"; /* Copied in on every call; gcc may call memcpy (dtekv-mem.c) for it. */
   char * cp = cs; /* Declare cp as pointer, initialise cp to point to cs */
                                                                                                                                                                                              
   /* Do some calculation. */                                                                                                                                                                